@@ -0,0 +1,145 @@
+#ifndef ARRAY_HPP
+#define ARRAY_HPP
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <utility>
+#include "Memory.hpp"
+
+/**
+ * Contiguous array of T that either owns its elements, like std::vector, or borrows them
+ * read-only from a memory mapping (see Snapshot.hpp), which it keeps alive.
+ * Preprocessing builds owned arrays through the vector-like mutators; a borrowed array is copied
+ * into owned storage before it is modified, or before a mutable pointer or reference to its
+ * elements is returned. Owned elements come from the arrayMemory() resource current when the
+ * array (or the copy) was created, see Memory.hpp.
+ */
+template <typename T>
+class Array
+{
+public:
+    Array() : ptr(nullptr), length(0) {}
+
+    Array(const std::vector<T> &v) : storage(v.begin(), v.end()), ptr(storage.data()), length(storage.size()) {}
+
+    Array(const Array &other) : storage(other.storage),
+                                mapping(other.mapping),
+                                ptr(other.mapping ? other.ptr : storage.data()),
+                                length(other.length)
+    {
+    }
+
+    Array(Array &&other) : storage(std::move(other.storage)),
+                           mapping(std::move(other.mapping)),
+                           ptr(other.ptr),
+                           length(other.length)
+    {
+        other.ptr = nullptr;
+        other.length = 0;
+    }
+
+    Array &operator=(Array other)
+    {
+        swap(other);
+        return *this;
+    }
+
+    /**
+     * Returns an array over n elements at data, borrowed from the memory mapping that owns them.
+     */
+    static Array borrow(const T *data, size_t n, const std::shared_ptr<const void> &mapping)
+    {
+        Array a;
+        a.mapping = mapping;
+        a.ptr = const_cast<T *>(data);
+        a.length = n;
+        return a;
+    }
+
+    void swap(Array &other)
+    {
+        storage.swap(other.storage);
+        mapping.swap(other.mapping);
+        std::swap(ptr, other.ptr);
+        std::swap(length, other.length);
+    }
+
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+    const T *data() const { return ptr; }
+    T *data()
+    {
+        own();
+        return ptr;
+    }
+    const T &operator[](size_t i) const { return ptr[i]; }
+    T &operator[](size_t i)
+    {
+        own();
+        return ptr[i];
+    }
+    const T &back() const { return ptr[length - 1]; }
+    const T *begin() const { return ptr; }
+    const T *end() const { return ptr + length; }
+
+    void resize(size_t n)
+    {
+        own();
+        storage.resize(n);
+        sync();
+    }
+
+    void assign(size_t n, const T &value)
+    {
+        mapping.reset();
+        storage.assign(n, value);
+        sync();
+    }
+
+    void reserve(size_t n)
+    {
+        own();
+        storage.reserve(n);
+        sync();
+    }
+
+    void push_back(const T &value)
+    {
+        own();
+        storage.push_back(value);
+        sync();
+    }
+
+    void clear()
+    {
+        mapping.reset();
+        storage.clear();
+        sync();
+    }
+
+private:
+    std::vector<T, ResourceAllocator<T>> storage;
+    std::shared_ptr<const void> mapping; // set when the elements are borrowed
+    T *ptr;
+    size_t length;
+
+    // copies borrowed elements into owned storage, as the mapping is read-only
+    void own()
+    {
+        if (mapping)
+        {
+            storage.assign(ptr, ptr + length);
+            mapping.reset();
+            sync();
+        }
+    }
+
+    void sync()
+    {
+        ptr = storage.data();
+        length = storage.size();
+    }
+};
+
+#endif // ARRAY_HPP
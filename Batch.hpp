@@ -0,0 +1,37 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include <cstddef>
+#include <stdexcept>
+
+// Batched queries are processed in tiles of this many queries: each stage of a query
+// is issued for the whole tile before the next one, so the random accesses of the
+// tile overlap instead of stalling one after another.
+#define BATCH_TILE_SIZE 32
+
+// Minimum number of queries per thread in a batch
+#define BATCH_THREAD_GRAIN 8192
+
+/**
+ * Hints the CPU to start loading the cache line holding addr.
+ */
+inline void prefetch(const void *addr)
+{
+    __builtin_prefetch(addr);
+}
+
+/**
+ * Checks once, before a batch runs, that every index lies in [0, size).
+ */
+inline void validateBatchIndices(const int *src, const int *dst, size_t n, size_t size)
+{
+    for (size_t q = 0; q < n; q++)
+    {
+        if ((size_t)src[q] >= size || (size_t)dst[q] >= size) // negative indices wrap around
+        {
+            throw std::out_of_range("Index out of bounds.");
+        }
+    }
+}
+
+#endif // BATCH_HPP
@@ -0,0 +1,339 @@
+#include "BenchUtils.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+#include <cstring>
+#include <cmath>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+const char *treeShapeName(TreeShape shape)
+{
+    switch (shape)
+    {
+    case SHAPE_RANDOM:
+        return "random";
+    case SHAPE_PATH:
+        return "path";
+    case SHAPE_STAR:
+        return "star";
+    case SHAPE_KARY:
+        return "kary";
+    case SHAPE_CATERPILLAR:
+        return "caterpillar";
+    }
+    return "";
+}
+
+std::vector<int> generateTree(TreeShape shape, int n, std::mt19937 &rng)
+{
+    std::vector<int> parent(n);
+    parent[0] = -1;
+    int spine = std::max(1, n / 2);
+    for (int i = 1; i < n; i++)
+    {
+        switch (shape)
+        {
+        case SHAPE_RANDOM:
+            parent[i] = rng() % i;
+            break;
+        case SHAPE_PATH:
+            parent[i] = i - 1;
+            break;
+        case SHAPE_STAR:
+            parent[i] = 0;
+            break;
+        case SHAPE_KARY:
+            parent[i] = (i - 1) / BENCH_KARY_ARITY;
+            break;
+        case SHAPE_CATERPILLAR:
+            parent[i] = i < spine ? i - 1 : rng() % spine;
+            break;
+        }
+    }
+    return parent;
+}
+
+const char *queryDistributionName(QueryDistribution distribution)
+{
+    switch (distribution)
+    {
+    case QUERIES_UNIFORM:
+        return "uniform";
+    case QUERIES_ANCESTOR:
+        return "ancestor";
+    case QUERIES_SAME_BLOCK:
+        return "same-block";
+    case QUERIES_FAR_APART:
+        return "far-apart";
+    case QUERIES_MIXED:
+        return "mixed";
+    }
+    return "";
+}
+
+void generateZipfQueries(int n, size_t count, double exponent, std::mt19937 &rng,
+                         std::vector<int> &src, std::vector<int> &dst)
+{
+    std::vector<int> pairSrc(n), pairDst(n);
+    std::vector<double> cumulative(n);
+    double weight = 0;
+    for (int r = 0; r < n; r++)
+    {
+        pairSrc[r] = rng() % n;
+        pairDst[r] = n > 1 ? (pairSrc[r] + 1 + rng() % (n - 1)) % n : 0;
+        weight += std::pow(r + 1.0, -exponent);
+        cumulative[r] = weight;
+    }
+
+    // draw a rank by inverting the cumulative weights
+    std::uniform_real_distribution<double> uniform(0, weight);
+    src.resize(count);
+    dst.resize(count);
+    for (size_t q = 0; q < count; q++)
+    {
+        int r = std::upper_bound(cumulative.begin(), cumulative.end(), uniform(rng)) - cumulative.begin();
+        r = std::min(r, n - 1);
+        src[q] = pairSrc[r];
+        dst[q] = pairDst[r];
+    }
+}
+
+std::vector<int> preOrderTraversal(const std::vector<int> &parent)
+{
+    int n = parent.size();
+
+    // child lists in CSR form, by increasing index
+    std::vector<int> offsets(n + 1, 0), childList(std::max(0, n - 1));
+    int root = 0;
+    for (int v = 0; v < n; v++)
+    {
+        if (parent[v] == -1)
+            root = v;
+        else
+            offsets[parent[v] + 1]++;
+    }
+    for (int v = 0; v < n; v++)
+    {
+        offsets[v + 1] += offsets[v];
+    }
+    std::vector<int> next(offsets.begin(), offsets.end() - 1);
+    for (int v = 0; v < n; v++)
+    {
+        if (parent[v] != -1)
+            childList[next[parent[v]]++] = v;
+    }
+
+    // children are pushed in reverse, so that they are visited left to right
+    std::vector<int> preOrder, stack(1, root);
+    preOrder.reserve(n);
+    while (!stack.empty())
+    {
+        int v = stack.back();
+        stack.pop_back();
+        preOrder.push_back(v);
+        for (int c = offsets[v + 1] - 1; c >= offsets[v]; c--)
+        {
+            stack.push_back(childList[c]);
+        }
+    }
+    return preOrder;
+}
+
+void generateQueries(QueryDistribution distribution,
+                     const std::vector<int> &parent,
+                     const std::vector<int> &preOrder,
+                     size_t count,
+                     std::mt19937 &rng,
+                     std::vector<int> &src,
+                     std::vector<int> &dst)
+{
+    int n = parent.size();
+    src.resize(count);
+    dst.resize(count);
+    int edge = std::max(1, n / 100);
+    for (size_t q = 0; q < count; q++)
+    {
+        int i, j;
+        switch (distribution)
+        {
+        case QUERIES_UNIFORM:
+            i = rng() % n;
+            j = rng() % n;
+            break;
+        case QUERIES_ANCESTOR:
+        {
+            // walk up a random number of levels from a non-root node
+            do
+            {
+                j = rng() % n;
+            } while (parent[j] == -1 && n > 1);
+            i = j;
+            int levels = 1 + rng() % 64;
+            for (int l = 0; l < levels && parent[i] != -1; l++)
+            {
+                i = parent[i];
+            }
+            break;
+        }
+        case QUERIES_SAME_BLOCK:
+        {
+            int p = rng() % n;
+            i = preOrder[p];
+            j = preOrder[std::min(n - 1, p + (int)(rng() % 9))];
+            break;
+        }
+        case QUERIES_MIXED:
+        {
+            int p = rng() % n;
+            i = preOrder[p];
+            j = rng() % 2 ? preOrder[std::min(n - 1, p + (int)(rng() % 9))] : rng() % n;
+            break;
+        }
+        case QUERIES_FAR_APART:
+            i = preOrder[rng() % edge];
+            j = preOrder[n - 1 - rng() % edge];
+            break;
+        }
+        src[q] = i;
+        dst[q] = j;
+    }
+}
+
+std::vector<double> measure(const std::function<void()> &fn, double minTime, int maxIterations)
+{
+    std::vector<double> runTimes;
+    double total = 0;
+    while (runTimes.empty() || (total < minTime && runTimes.size() < maxIterations))
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        fn();
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(end - start).count();
+        runTimes.push_back(seconds);
+        total += seconds;
+    }
+    return runTimes;
+}
+
+void doNotOptimize(long value)
+{
+    static volatile long sink;
+    sink = value;
+}
+
+TlbMissCounter::TlbMissCounter()
+{
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+TlbMissCounter::~TlbMissCounter()
+{
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+}
+
+void TlbMissCounter::start()
+{
+    if (fd >= 0)
+    {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+long TlbMissCounter::stop()
+{
+    long count;
+    if (fd < 0)
+    {
+        return -1;
+    }
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    return read(fd, &count, sizeof(count)) == sizeof(count) ? count : -1;
+}
+
+long anonHugePageBytes()
+{
+    std::ifstream smaps("/proc/self/smaps_rollup");
+    std::string key;
+    long kilobytes;
+    while (smaps >> key)
+    {
+        if (key == "AnonHugePages:" && smaps >> kilobytes)
+        {
+            return kilobytes * 1024;
+        }
+    }
+    return -1;
+}
+
+BenchResult makeResult(const std::string &benchmark, const std::string &shape, const std::string &distribution,
+                       long size, const std::vector<double> &runTimes, size_t opsPerRun)
+{
+    std::vector<double> sorted(runTimes);
+    std::sort(sorted.begin(), sorted.end());
+
+    BenchResult result;
+    result.benchmark = benchmark;
+    result.shape = shape;
+    result.distribution = distribution;
+    result.size = size;
+    result.iterations = sorted.size();
+    result.time = 1e6 * sorted[sorted.size() / 2] / opsPerRun;
+    result.minTime = 1e6 * sorted[0] / opsPerRun;
+    result.throughput = 1e6 / result.time;
+    return result;
+}
+
+void writeResultsCSV(const std::vector<BenchResult> &results, const std::string &path)
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        throw std::runtime_error("Cannot open " + path);
+    }
+    file << "Benchmark,Shape,Distribution,TreeSize,Iterations,Time,MinTime,Throughput\n";
+    for (const BenchResult &r : results)
+    {
+        file << r.benchmark << "," << r.shape << "," << r.distribution << "," << r.size << ","
+             << r.iterations << "," << r.time << "," << r.minTime << "," << r.throughput << "\n";
+    }
+}
+
+void writeResultsJSON(const std::vector<BenchResult> &results, const std::string &path)
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        throw std::runtime_error("Cannot open " + path);
+    }
+    file << "{\n  \"context\": {\n    \"num_cpus\": " << std::thread::hardware_concurrency() << "\n  },\n";
+    file << "  \"benchmarks\": [\n";
+    for (size_t k = 0; k < results.size(); k++)
+    {
+        const BenchResult &r = results[k];
+        std::string name = r.benchmark + "/" + r.shape + (r.distribution.empty() ? "" : "/" + r.distribution) + "/" + std::to_string(r.size);
+        file << "    {\"name\": \"" << name << "\", \"run_type\": \"iteration\""
+             << ", \"shape\": \"" << r.shape << "\", \"distribution\": \"" << r.distribution << "\""
+             << ", \"size\": " << r.size << ", \"iterations\": " << r.iterations
+             << ", \"real_time\": " << r.time * 1000 << ", \"min_time\": " << r.minTime * 1000
+             << ", \"time_unit\": \"ns\", \"items_per_second\": " << r.throughput << "}"
+             << (k + 1 < results.size() ? ",\n" : "\n");
+    }
+    file << "  ]\n}\n";
+}
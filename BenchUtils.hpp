@@ -0,0 +1,174 @@
+#ifndef BENCHUTILS_HPP
+#define BENCHUTILS_HPP
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <random>
+#include <cstddef>
+#include <atomic>
+#include "Memory.hpp"
+
+/*** Tree shapes ***/
+
+// Shapes of generated trees, as parent arrays with the root at index 0
+enum TreeShape
+{
+    SHAPE_RANDOM,      // parent of i uniform in [0, i - 1]
+    SHAPE_PATH,        // parent of i is i - 1
+    SHAPE_STAR,        // every node is a child of the root
+    SHAPE_KARY,        // complete BENCH_KARY_ARITY-ary tree, in level order
+    SHAPE_CATERPILLAR, // path of n / 2 nodes, each remaining node a leaf of a random path node
+};
+
+#define BENCH_KARY_ARITY 4
+
+const char *treeShapeName(TreeShape shape);
+std::vector<int> generateTree(TreeShape shape, int n, std::mt19937 &rng);
+
+/*** Query distributions ***/
+
+// Distributions of (source, destination) node pairs
+enum QueryDistribution
+{
+    QUERIES_UNIFORM,    // both nodes uniform
+    QUERIES_ANCESTOR,   // source is a proper ancestor of the destination (up to 64 levels above)
+    QUERIES_SAME_BLOCK, // nodes at most 8 apart in pre-order, so close in the Euler Tour
+    QUERIES_FAR_APART,  // nodes from the first and last 1% of the pre-order
+    QUERIES_MIXED,      // same-block and uniform pairs in random order, so that no query path is predictable
+};
+
+const char *queryDistributionName(QueryDistribution distribution);
+
+/**
+ * Generates count node pairs with the given distribution over the tree with the given parent array.
+ * preOrder is the pre-order traversal of the tree (see preOrderTraversal).
+ */
+void generateQueries(QueryDistribution distribution,
+                     const std::vector<int> &parent,
+                     const std::vector<int> &preOrder,
+                     size_t count,
+                     std::mt19937 &rng,
+                     std::vector<int> &src,
+                     std::vector<int> &dst);
+
+/**
+ * Generates count node pairs over n nodes with Zipf-distributed popularity: n random pairs of
+ * distinct nodes (when n > 1) are ranked, and the pair of rank r (from 1) is drawn with
+ * probability proportional to 1 / r^exponent. An exponent of 0 draws the n pairs uniformly.
+ */
+void generateZipfQueries(int n, size_t count, double exponent, std::mt19937 &rng,
+                         std::vector<int> &src, std::vector<int> &dst);
+
+/**
+ * Pre-order traversal of the tree with the given parent array (children by increasing index).
+ */
+std::vector<int> preOrderTraversal(const std::vector<int> &parent);
+
+/*** Measurement ***/
+
+/**
+ * Runs fn repeatedly, until at least minTime seconds have elapsed (and at least once), and returns
+ * the elapsed time of each run in seconds, measured with a steady clock.
+ */
+std::vector<double> measure(const std::function<void()> &fn, double minTime, int maxIterations = 1000);
+
+/**
+ * Keeps the compiler from optimising away a computed value.
+ */
+void doNotOptimize(long value);
+
+/**
+ * Counts the data TLB load misses of the calling thread through perf_event_open. Where the
+ * counter cannot be opened (no PMU, as in most VMs, or a restrictive perf_event_paranoid),
+ * available() is false and stop() returns -1.
+ */
+class TlbMissCounter
+{
+public:
+    TlbMissCounter();
+    ~TlbMissCounter();
+
+    bool available() const { return fd >= 0; }
+    void start();
+    long stop();
+
+private:
+    int fd;
+
+    TlbMissCounter(const TlbMissCounter &) = delete;
+    TlbMissCounter &operator=(const TlbMissCounter &) = delete;
+};
+
+/**
+ * Heap memory that keeps track of the bytes allocated through it, e.g. to measure the footprint
+ * of a structure built in a ScopedArrayMemory.
+ */
+class CountingMemory : public MemoryResource
+{
+public:
+    CountingMemory() : allocatedBytes(0), outstandingBytes(0) {}
+
+    void *allocate(size_t bytes) override
+    {
+        allocatedBytes += bytes;
+        outstandingBytes += bytes;
+        return heapMemory()->allocate(bytes);
+    }
+
+    void deallocate(void *p, size_t bytes) override
+    {
+        outstandingBytes -= bytes;
+        heapMemory()->deallocate(p, bytes);
+    }
+
+    /**
+     * Returns the bytes allocated so far, including those given back since.
+     */
+    size_t allocated() const { return allocatedBytes.load(); }
+
+    /**
+     * Returns the bytes currently allocated.
+     */
+    size_t outstanding() const { return outstandingBytes.load(); }
+
+private:
+    std::atomic<size_t> allocatedBytes, outstandingBytes;
+};
+
+/**
+ * Returns the bytes of the process's anonymous memory backed by transparent huge pages,
+ * or -1 if the kernel does not report them.
+ */
+long anonHugePageBytes();
+
+// One benchmark result: the time of one operation (a preprocessing run or a single query)
+struct BenchResult
+{
+    std::string benchmark;    // e.g. "NextNodeOnPath/query"
+    std::string shape;        // tree shape, or sequence kind
+    std::string distribution; // query distribution, empty for preprocessing
+    long size;                // number of tree nodes or sequence elements
+    int iterations;           // timed runs
+    double time;              // median time per operation, in microseconds
+    double minTime;           // fastest time per operation, in microseconds
+    double throughput;        // operations per second, from the median
+};
+
+/**
+ * Builds a result from the run times returned by measure(), each covering opsPerRun operations.
+ */
+BenchResult makeResult(const std::string &benchmark, const std::string &shape, const std::string &distribution,
+                       long size, const std::vector<double> &runTimes, size_t opsPerRun);
+
+/**
+ * Writes the results as CSV (one row per result, times in microseconds, as in test_results)
+ */
+void writeResultsCSV(const std::vector<BenchResult> &results, const std::string &path);
+
+/**
+ * Writes the results as JSON, in the layout of Google Benchmark's JSON reporter.
+ */
+void writeResultsJSON(const std::vector<BenchResult> &results, const std::string &path);
+
+#endif // BENCHUTILS_HPP
@@ -0,0 +1,305 @@
+#include "BlockKernels.hpp"
+#include <algorithm>
+#include <mutex>
+#include <immintrin.h>
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+#define AVX512_TARGET __attribute__((target("avx512f")))
+
+static SimdLevel detect()
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return SIMD_AVX512;
+    if (__builtin_cpu_supports("avx2"))
+        return SIMD_AVX2;
+    return SIMD_SCALAR;
+}
+
+SimdLevel detectSimdLevel()
+{
+    static const SimdLevel level = detect();
+    return level;
+}
+
+const char *simdLevelName(SimdLevel level)
+{
+    switch (level)
+    {
+    case SIMD_SCALAR:
+        return "scalar";
+    case SIMD_AVX2:
+        return "avx2";
+    case SIMD_AVX512:
+        return "avx512";
+    }
+    return "";
+}
+
+static void buildInBlockTables(int blockSize, InBlockTables &tables)
+{
+    int binaryStrings = 1 << (blockSize - 1);
+    tables.MIN.resize(binaryStrings * blockSize * blockSize + 16);
+    tables.suffixMin.resize(binaryStrings * blockSize + 16);
+    for (int s = 0; s < binaryStrings; s++)
+    {
+        uint8_t *table = &tables.MIN[s * blockSize * blockSize];
+        for (int i = 0; i < blockSize; i++)
+        {
+            // walk the relative depths from i, as given by the +/-1 steps of the binary string
+            int d = 0, minD = 0, minIndex = i;
+            table[i * blockSize + i] = i;
+            for (int j = i + 1; j < blockSize; j++)
+            {
+                d += (s >> (j - 1)) & 1 ? 1 : -1;
+                if (d < minD)
+                {
+                    minD = d;
+                    minIndex = j;
+                }
+                table[i * blockSize + j] = minIndex;
+            }
+            tables.suffixMin[s * blockSize + i] = table[i * blockSize + blockSize - 1];
+        }
+    }
+}
+
+const InBlockTables &inBlockTables(int blockSize)
+{
+    static std::once_flag built[LCA_MAX_BLOCK_BITS + 1];
+    static InBlockTables tables[LCA_MAX_BLOCK_BITS + 1];
+    int blockBits = __builtin_ctz(blockSize);
+    std::call_once(built[blockBits], buildInBlockTables, blockSize, std::ref(tables[blockBits]));
+    return tables[blockBits];
+}
+
+/*** upStepBits ***/
+
+// fills one word of +1 steps, for positions start...end - 1
+static uint64_t upStepWord(const int *seq, size_t start, size_t end)
+{
+    uint64_t word = 0;
+    for (size_t i = start; i < end; i++)
+    {
+        if (seq[i + 1] == seq[i] + 1)
+            word |= (uint64_t)1 << (i - start);
+    }
+    return word;
+}
+
+static void upStepBitsScalar(const int *seq, size_t last, size_t firstWord, size_t lastWord, uint64_t *steps)
+{
+    for (size_t w = firstWord; w < lastWord; w++)
+    {
+        steps[w] = upStepWord(seq, std::min(64 * w, last), std::min(64 * w + 64, last));
+    }
+}
+
+AVX2_TARGET static void upStepBitsAVX2(const int *seq, size_t last, size_t firstWord, size_t lastWord, uint64_t *steps)
+{
+    const __m256i one = _mm256_set1_epi32(1);
+    for (size_t w = firstWord; w < lastWord; w++)
+    {
+        size_t start = 64 * w;
+        if (start + 64 > last)
+        {
+            steps[w] = upStepWord(seq, std::min(start, last), last);
+            continue;
+        }
+        uint64_t word = 0;
+        for (int k = 0; k < 64; k += 8)
+        {
+            __m256i a = _mm256_loadu_si256((const __m256i *)(seq + start + k));
+            __m256i b = _mm256_loadu_si256((const __m256i *)(seq + start + k + 1));
+            __m256i up = _mm256_cmpeq_epi32(b, _mm256_add_epi32(a, one));
+            word |= (uint64_t)_mm256_movemask_ps(_mm256_castsi256_ps(up)) << k;
+        }
+        steps[w] = word;
+    }
+}
+
+AVX512_TARGET static void upStepBitsAVX512(const int *seq, size_t last, size_t firstWord, size_t lastWord, uint64_t *steps)
+{
+    const __m512i one = _mm512_set1_epi32(1);
+    for (size_t w = firstWord; w < lastWord; w++)
+    {
+        size_t start = 64 * w;
+        if (start + 64 > last)
+        {
+            steps[w] = upStepWord(seq, std::min(start, last), last);
+            continue;
+        }
+        uint64_t word = 0;
+        for (int k = 0; k < 64; k += 16)
+        {
+            __m512i a = _mm512_loadu_si512(seq + start + k);
+            __m512i b = _mm512_loadu_si512(seq + start + k + 1);
+            word |= (uint64_t)_mm512_cmpeq_epi32_mask(b, _mm512_add_epi32(a, one)) << k;
+        }
+        steps[w] = word;
+    }
+}
+
+void upStepBits(const int *seq, size_t n, size_t firstWord, size_t lastWord, uint64_t *steps, SimdLevel level)
+{
+    size_t last = n > 0 ? n - 1 : 0; // steps start at positions 0...n - 2
+    switch (level)
+    {
+    case SIMD_AVX512:
+        upStepBitsAVX512(seq, last, firstWord, lastWord, steps);
+        break;
+    case SIMD_AVX2:
+        upStepBitsAVX2(seq, last, firstWord, lastWord, steps);
+        break;
+    default:
+        upStepBitsScalar(seq, last, firstWord, lastWord, steps);
+    }
+}
+
+/*** expandBlockMinima ***/
+
+// the min over the prefix ending at offset t is MIN[s][0][t], so row 0 of block string s is the prefix row
+static void expandBlockMinimaScalar(const uint16_t *binaryStrings, size_t firstBlock, size_t lastBlock, int blockSize,
+                                    const InBlockTables &tables, int *prefixMin, int *suffixMin, int *blockMin)
+{
+    for (size_t b = firstBlock; b < lastBlock; b++)
+    {
+        int start = b * blockSize;
+        const uint8_t *prefixRow = &tables.MIN[binaryStrings[b] * blockSize * blockSize];
+        const uint8_t *suffixRow = &tables.suffixMin[binaryStrings[b] * blockSize];
+        for (int t = 0; t < blockSize; t++)
+        {
+            prefixMin[start + t] = start + prefixRow[t];
+            suffixMin[start + t] = start + suffixRow[t];
+        }
+        blockMin[b] = start + prefixRow[blockSize - 1];
+    }
+}
+
+// a block is two halves of 8 lanes, stored under masks of the offsets below blockSize
+AVX2_TARGET static void expandBlockMinimaAVX2(const uint16_t *binaryStrings, size_t firstBlock, size_t lastBlock, int blockSize,
+                                              const InBlockTables &tables, int *prefixMin, int *suffixMin, int *blockMin)
+{
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i lowMask = _mm256_cmpgt_epi32(_mm256_set1_epi32(blockSize), lanes);
+    const __m256i highMask = _mm256_cmpgt_epi32(_mm256_set1_epi32(blockSize - 8), lanes);
+    for (size_t b = firstBlock; b < lastBlock; b++)
+    {
+        int start = b * blockSize;
+        const uint8_t *prefixRow = &tables.MIN[binaryStrings[b] * blockSize * blockSize];
+        const uint8_t *suffixRow = &tables.suffixMin[binaryStrings[b] * blockSize];
+        __m256i offset = _mm256_set1_epi32(start);
+
+        __m256i low = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)prefixRow));
+        __m256i high = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(prefixRow + 8)));
+        _mm256_maskstore_epi32(prefixMin + start, lowMask, _mm256_add_epi32(low, offset));
+        _mm256_maskstore_epi32(prefixMin + start + 8, highMask, _mm256_add_epi32(high, offset));
+
+        low = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)suffixRow));
+        high = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(suffixRow + 8)));
+        _mm256_maskstore_epi32(suffixMin + start, lowMask, _mm256_add_epi32(low, offset));
+        _mm256_maskstore_epi32(suffixMin + start + 8, highMask, _mm256_add_epi32(high, offset));
+
+        blockMin[b] = start + prefixRow[blockSize - 1];
+    }
+}
+
+// a block fits in one register of 16 lanes
+AVX512_TARGET static void expandBlockMinimaAVX512(const uint16_t *binaryStrings, size_t firstBlock, size_t lastBlock, int blockSize,
+                                                  const InBlockTables &tables, int *prefixMin, int *suffixMin, int *blockMin)
+{
+    __mmask16 mask = (1u << blockSize) - 1;
+    for (size_t b = firstBlock; b < lastBlock; b++)
+    {
+        int start = b * blockSize;
+        const uint8_t *prefixRow = &tables.MIN[binaryStrings[b] * blockSize * blockSize];
+        const uint8_t *suffixRow = &tables.suffixMin[binaryStrings[b] * blockSize];
+        __m512i offset = _mm512_set1_epi32(start);
+
+        __m512i prefix = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *)prefixRow));
+        _mm512_mask_storeu_epi32(prefixMin + start, mask, _mm512_add_epi32(prefix, offset));
+        __m512i suffix = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *)suffixRow));
+        _mm512_mask_storeu_epi32(suffixMin + start, mask, _mm512_add_epi32(suffix, offset));
+
+        blockMin[b] = start + prefixRow[blockSize - 1];
+    }
+}
+
+void expandBlockMinima(const uint16_t *binaryStrings, size_t firstBlock, size_t lastBlock, int blockSize,
+                       const InBlockTables &tables, int *prefixMin, int *suffixMin, int *blockMin, SimdLevel level)
+{
+    switch (level)
+    {
+    case SIMD_AVX512:
+        expandBlockMinimaAVX512(binaryStrings, firstBlock, lastBlock, blockSize, tables, prefixMin, suffixMin, blockMin);
+        break;
+    case SIMD_AVX2:
+        expandBlockMinimaAVX2(binaryStrings, firstBlock, lastBlock, blockSize, tables, prefixMin, suffixMin, blockMin);
+        break;
+    default:
+        expandBlockMinimaScalar(binaryStrings, firstBlock, lastBlock, blockSize, tables, prefixMin, suffixMin, blockMin);
+    }
+}
+
+/*** sparseTableLevel ***/
+
+static void sparseTableLevelScalar(const int *index, const int *depth, size_t begin, size_t end, size_t half,
+                                   int *outIndex, int *outDepth)
+{
+    for (size_t i = begin; i < end; i++)
+    {
+        bool first = depth[i] < depth[i + half];
+        outIndex[i] = first ? index[i] : index[i + half];
+        outDepth[i] = first ? depth[i] : depth[i + half];
+    }
+}
+
+AVX2_TARGET static void sparseTableLevelAVX2(const int *index, const int *depth, size_t begin, size_t end, size_t half,
+                                             int *outIndex, int *outDepth)
+{
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8)
+    {
+        __m256i firstDepth = _mm256_loadu_si256((const __m256i *)(depth + i));
+        __m256i secondDepth = _mm256_loadu_si256((const __m256i *)(depth + i + half));
+        __m256i first = _mm256_cmpgt_epi32(secondDepth, firstDepth);
+        __m256i firstIndex = _mm256_loadu_si256((const __m256i *)(index + i));
+        __m256i secondIndex = _mm256_loadu_si256((const __m256i *)(index + i + half));
+        _mm256_storeu_si256((__m256i *)(outIndex + i), _mm256_blendv_epi8(secondIndex, firstIndex, first));
+        _mm256_storeu_si256((__m256i *)(outDepth + i), _mm256_min_epi32(firstDepth, secondDepth));
+    }
+    sparseTableLevelScalar(index, depth, i, end, half, outIndex, outDepth);
+}
+
+AVX512_TARGET static void sparseTableLevelAVX512(const int *index, const int *depth, size_t begin, size_t end, size_t half,
+                                                 int *outIndex, int *outDepth)
+{
+    size_t i = begin;
+    for (; i + 16 <= end; i += 16)
+    {
+        __m512i firstDepth = _mm512_loadu_si512(depth + i);
+        __m512i secondDepth = _mm512_loadu_si512(depth + i + half);
+        __mmask16 first = _mm512_cmplt_epi32_mask(firstDepth, secondDepth);
+        __m512i firstIndex = _mm512_loadu_si512(index + i);
+        __m512i secondIndex = _mm512_loadu_si512(index + i + half);
+        _mm512_storeu_si512(outIndex + i, _mm512_mask_blend_epi32(first, secondIndex, firstIndex));
+        _mm512_storeu_si512(outDepth + i, _mm512_min_epi32(firstDepth, secondDepth));
+    }
+    sparseTableLevelScalar(index, depth, i, end, half, outIndex, outDepth);
+}
+
+void sparseTableLevel(const int *index, const int *depth, size_t begin, size_t end, size_t half,
+                      int *outIndex, int *outDepth, SimdLevel level)
+{
+    switch (level)
+    {
+    case SIMD_AVX512:
+        sparseTableLevelAVX512(index, depth, begin, end, half, outIndex, outDepth);
+        break;
+    case SIMD_AVX2:
+        sparseTableLevelAVX2(index, depth, begin, end, half, outIndex, outDepth);
+        break;
+    default:
+        sparseTableLevelScalar(index, depth, begin, end, half, outIndex, outDepth);
+    }
+}
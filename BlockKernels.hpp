@@ -0,0 +1,77 @@
+#ifndef BLOCKKERNELS_HPP
+#define BLOCKKERNELS_HPP
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "LCA.hpp"
+
+// Largest block size LCA picks, so that block binary strings fit in a uint16_t and blocks in a 512-bit register
+#define LCA_MAX_BLOCK_SIZE (1 << LCA_MAX_BLOCK_BITS)
+
+/*
+Kernels of the block-level LCA preprocessing over the depth Euler Tour, each with a scalar,
+an AVX2 and an AVX-512 variant. The variants give identical results; the vector ones are compiled
+with per-function target attributes, so the rest of the build needs no extra flags, and
+detectSimdLevel() picks the widest one the CPU supports.
+*/
+
+// Instruction sets of the kernels, from the most portable
+enum SimdLevel
+{
+    SIMD_SCALAR = 0,
+    SIMD_AVX2 = 1,
+    SIMD_AVX512 = 2
+};
+
+/**
+ * Returns the widest instruction set supported by the CPU and the OS, detected once through CPUID.
+ */
+SimdLevel detectSimdLevel();
+
+const char *simdLevelName(SimdLevel level);
+
+/**
+ * In-block tables for one block size, over all the 2^(blockSize-1) block binary strings s
+ * (bit t - 1 of s is set iff the depth steps up into offset t):
+ * MIN[(s * blockSize + i) * blockSize + j] is the offset of the (leftmost) min over offsets i...j,
+ * and suffixMin[s * blockSize + i] the offset of the min over offsets i...blockSize - 1.
+ * Both are padded, so that 16 bytes can be read from the start of any row.
+ */
+struct InBlockTables
+{
+    std::vector<uint8_t> MIN;
+    std::vector<uint8_t> suffixMin;
+};
+
+/**
+ * Returns the in-block tables for blockSize, a power of two up to LCA_MAX_BLOCK_SIZE. Each block size is built
+ * once, on first use, and then shared read-only by all the instances of the process.
+ */
+const InBlockTables &inBlockTables(int blockSize);
+
+/**
+ * Marks the +1 steps of seq[0...n - 1] in a bitmap: bit i (bit i % 64 of word i / 64) is set
+ * iff seq[i + 1] == seq[i] + 1. Fills words firstWord...lastWord - 1 of steps, so that threads
+ * can fill disjoint ranges of words; bits from n - 1 onwards are 0.
+ */
+void upStepBits(const int *seq, size_t n, size_t firstWord, size_t lastWord, uint64_t *steps, SimdLevel level);
+
+/**
+ * Expands the in-block tables over the whole blocks firstBlock...lastBlock - 1, of blockSize
+ * positions each: prefixMin[p] and suffixMin[p] are the positions of the min over the prefix
+ * of p's block ending at p and over its suffix starting at p, and blockMin[b] the position of
+ * the min of block b. binaryStrings[b] is the binary string of block b.
+ */
+void expandBlockMinima(const uint16_t *binaryStrings, size_t firstBlock, size_t lastBlock, int blockSize,
+                       const InBlockTables &tables, int *prefixMin, int *suffixMin, int *blockMin, SimdLevel level);
+
+/**
+ * Builds the windows begin...end - 1 of a Sparse Table level from the previous level, whose
+ * windows have half the size: outIndex[i] is whichever of index[i] and index[i + half] has the
+ * smaller depth (index[i + half] on ties), and outDepth[i] is that depth.
+ */
+void sparseTableLevel(const int *index, const int *depth, size_t begin, size_t end, size_t half,
+                      int *outIndex, int *outDepth, SimdLevel level);
+
+#endif // BLOCKKERNELS_HPP
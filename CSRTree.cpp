@@ -0,0 +1,108 @@
+#include "CSRTree.hpp"
+#include <stdexcept>
+#include <utility>
+
+CSRTree::CSRTree(std::vector<int> parent) : parent(std::move(parent)), root(-1)
+{
+    int n = this->parent.size();
+    if (n == 0)
+    {
+        throw std::invalid_argument("Tree cannot be empty.");
+    }
+
+    // count the children of each node, shifted by one so that the prefix sums give the offsets
+    childOffsets.assign(n + 1, 0);
+    for (int v = 0; v < n; v++)
+    {
+        int p = this->parent[v];
+        if (p == -1)
+        {
+            if (root != -1)
+            {
+                throw std::invalid_argument("Tree must have exactly one root.");
+            }
+            root = v;
+        }
+        else if (p < 0 || p >= n)
+        {
+            throw std::out_of_range("Parent index out of bounds.");
+        }
+        else
+        {
+            childOffsets[p + 1]++;
+        }
+    }
+    if (root == -1)
+    {
+        throw std::invalid_argument("Tree must have exactly one root.");
+    }
+
+    for (int v = 0; v < n; v++)
+    {
+        childOffsets[v + 1] += childOffsets[v];
+    }
+
+    // place each child in its parent's slot; scanning by increasing index keeps children sorted
+    childList.resize(n - 1);
+    std::vector<int> next(childOffsets.begin(), childOffsets.end() - 1);
+    for (int v = 0; v < n; v++)
+    {
+        if (v != root)
+        {
+            childList[next[this->parent[v]]++] = v;
+        }
+    }
+
+    // a cycle among the parent links leaves its nodes, and those hanging from them, out of the
+    // root's subtree: walk it breadth-first, in place of the slots no longer needed
+    std::vector<int> &queue = next;
+    queue[0] = root;
+    int visited = 1;
+    for (int q = 0; q < visited; q++)
+    {
+        int v = queue[q];
+        for (int c = childOffsets[v]; c < childOffsets[v + 1]; c++)
+        {
+            queue[visited++] = childList[c];
+        }
+    }
+    if (visited != n)
+    {
+        throw std::invalid_argument("Parent links contain a cycle: not all nodes are reachable from the root.");
+    }
+}
+
+CSRTree::CSRTree(const std::vector<int> &parent,
+                 const std::vector<std::vector<int>> &children,
+                 int root) : parent(parent),
+                             root(root)
+{
+    if (children.empty())
+    {
+        throw std::invalid_argument("Tree cannot be empty.");
+    }
+
+    childOffsets.resize(children.size() + 1);
+    childOffsets[0] = 0;
+    for (int v = 0; v < children.size(); v++)
+    {
+        childOffsets[v + 1] = childOffsets[v] + children[v].size();
+    }
+
+    childList.reserve(childOffsets.back());
+    for (const std::vector<int> &nodeChildren : children)
+    {
+        childList.insert(childList.end(), nodeChildren.begin(), nodeChildren.end());
+    }
+}
+
+TreeView CSRTree::view() const
+{
+    TreeView tree;
+    tree.size = childOffsets.size() - 1;
+    tree.root = root;
+    tree.parent = parent.data();
+    tree.childOffsets = childOffsets.data();
+    tree.childList = childList.data();
+    return tree;
+}
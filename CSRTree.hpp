@@ -0,0 +1,56 @@
+#ifndef CSRTREE_HPP
+#define CSRTREE_HPP
+
+#include <vector>
+
+/**
+ * Non-owning view of a rooted tree in compressed-sparse-row (CSR) form.
+ * The children of node v are childList[childOffsets[v]], ..., childList[childOffsets[v + 1] - 1],
+ * from left to right. The view does not own any memory: the arrays must outlive it.
+ */
+struct TreeView
+{
+    int size;                // number of nodes
+    int root;                // index of the root
+    const int *parent;       // parent[v] is the parent of v (-1 for the root)
+    const int *childOffsets; // size + 1 offsets into childList
+    const int *childList;    // size - 1 child indices, grouped by parent
+};
+
+/**
+ * Owning CSR representation of a rooted tree. It can be built directly from a parent array,
+ * avoiding per-node child lists, or converted from the std::vector<std::vector<int>> representation.
+ */
+class CSRTree
+{
+public:
+    /**
+     * Constructor. Builds the child arrays from a parent array by counting sort;
+     * the root is the (only) node whose parent is -1, and children are ordered by index.
+     * Throws std::invalid_argument unless the links form a single tree: one root, parents in range,
+     * and every node reachable from the root (no cycles).
+     * @param parent parent links (moved from, if passed as an rvalue)
+     */
+    CSRTree(std::vector<int> parent);
+
+    /**
+     * Constructor. Converts per-node child lists, keeping the order of the children.
+     * The lists are expected to describe a valid tree hanging from root; they are not checked.
+     */
+    CSRTree(const std::vector<int> &parent,
+            const std::vector<std::vector<int>> &children,
+            int root);
+
+    /**
+     * Returns a non-owning view over this tree, valid as long as this object is alive.
+     */
+    TreeView view() const;
+
+private:
+    std::vector<int> parent;
+    std::vector<int> childOffsets;
+    std::vector<int> childList;
+    int root;
+};
+
+#endif // CSRTREE_HPP
@@ -0,0 +1,261 @@
+#include "DynamicTree.hpp"
+#include <stdexcept>
+
+DynamicTree::DynamicTree(int n)
+{
+    Node isolated = {-1, -1, -1, 1};
+    nodes.assign(n, isolated);
+}
+
+DynamicTree::DynamicTree(const TreeView &tree)
+{
+    // every node starts as a single-node path, whose path-parent is its tree parent
+    nodes.resize(tree.size);
+    for (int v = 0; v < tree.size; v++)
+    {
+        Node node = {-1, -1, tree.parent[v], 1};
+        nodes[v] = node;
+    }
+}
+
+int DynamicTree::addNode()
+{
+    Node isolated = {-1, -1, -1, 1};
+    nodes.push_back(isolated);
+    return nodes.size() - 1;
+}
+
+int DynamicTree::addLeaf(int parent)
+{
+    checkIndex(parent);
+    int v = addNode();
+    nodes[v].parent = parent; // a single-node path hanging from parent
+    return v;
+}
+
+void DynamicTree::link(int v, int parent)
+{
+    checkIndex(v);
+    checkIndex(parent);
+    if (findRoot(v) != v)
+    {
+        throw std::invalid_argument("Linked node must be the root of its tree.");
+    }
+    if (findRoot(parent) == v)
+    {
+        throw std::invalid_argument("Link would create a cycle.");
+    }
+
+    // v is now alone at the top of its path: hang the path from parent
+    access(v);
+    nodes[v].parent = parent;
+}
+
+void DynamicTree::cut(int v)
+{
+    checkIndex(v);
+
+    // after access, the left splay subtree of v holds exactly its proper ancestors
+    access(v);
+    int ancestors = nodes[v].left;
+    if (ancestors != -1)
+    {
+        nodes[ancestors].parent = -1;
+        nodes[v].left = -1;
+        update(v);
+    }
+}
+
+int DynamicTree::lca(int i, int j)
+{
+    checkIndex(i);
+    checkIndex(j);
+    if (findRoot(i) != findRoot(j))
+    {
+        return -1;
+    }
+
+    // after accessing i, accessing j climbs until it joins the root-to-i path, at the LCA
+    access(i);
+    return access(j);
+}
+
+int DynamicTree::query(int i, int j)
+{
+    int a = lca(i, j);
+    if (a == -1 || i == j)
+    {
+        return -1;
+    }
+
+    if (a != i) // j not in i's subtree: go up
+    {
+        return parent(i);
+    }
+
+    // j is in i's subtree: descend into the child of i on the path to j
+    return ancestorAtDepth(j, depth(i) + 1);
+}
+
+int DynamicTree::parent(int v)
+{
+    checkIndex(v);
+    access(v);
+
+    // the parent is the deepest proper ancestor: the rightmost node of the left splay subtree
+    int x = nodes[v].left;
+    if (x == -1)
+    {
+        return -1;
+    }
+    while (nodes[x].right != -1)
+    {
+        x = nodes[x].right;
+    }
+    splay(x);
+    return x;
+}
+
+int DynamicTree::depth(int v)
+{
+    checkIndex(v);
+    access(v);
+    return splaySize(nodes[v].left);
+}
+
+int DynamicTree::findRoot(int v)
+{
+    checkIndex(v);
+    access(v);
+
+    // the root is the shallowest node on the path: the leftmost one
+    int x = v;
+    while (nodes[x].left != -1)
+    {
+        x = nodes[x].left;
+    }
+    splay(x);
+    return x;
+}
+
+int DynamicTree::size() const
+{
+    return nodes.size();
+}
+
+void DynamicTree::checkIndex(int v) const
+{
+    if (v < 0 || v >= nodes.size())
+    {
+        throw std::out_of_range("Index out of bounds.");
+    }
+}
+
+// finds the ancestor of v at depth d <= depth(v), as the d-th node of the root-to-v path
+int DynamicTree::ancestorAtDepth(int v, int d)
+{
+    access(v);
+    int x = v;
+    while (true)
+    {
+        int leftSize = splaySize(nodes[x].left);
+        if (d < leftSize)
+        {
+            x = nodes[x].left;
+        }
+        else if (d > leftSize)
+        {
+            d -= leftSize + 1;
+            x = nodes[x].right;
+        }
+        else
+        {
+            splay(x);
+            return x;
+        }
+    }
+}
+
+bool DynamicTree::isSplayRoot(int x) const
+{
+    int p = nodes[x].parent;
+    return p == -1 || (nodes[p].left != x && nodes[p].right != x);
+}
+
+int DynamicTree::splaySize(int x) const
+{
+    return x == -1 ? 0 : nodes[x].size;
+}
+
+void DynamicTree::update(int x)
+{
+    nodes[x].size = 1 + splaySize(nodes[x].left) + splaySize(nodes[x].right);
+}
+
+// rotates x above its splay parent, keeping the in-order (depth) sequence
+void DynamicTree::rotate(int x)
+{
+    int p = nodes[x].parent, g = nodes[p].parent;
+    bool pWasRoot = isSplayRoot(p);
+
+    if (nodes[p].left == x)
+    {
+        nodes[p].left = nodes[x].right;
+        if (nodes[x].right != -1)
+            nodes[nodes[x].right].parent = p;
+        nodes[x].right = p;
+    }
+    else
+    {
+        nodes[p].right = nodes[x].left;
+        if (nodes[x].left != -1)
+            nodes[nodes[x].left].parent = p;
+        nodes[x].left = p;
+    }
+    nodes[p].parent = x;
+    nodes[x].parent = g; // keeps the path-parent if p was the splay root
+
+    if (!pWasRoot)
+    {
+        if (nodes[g].left == p)
+            nodes[g].left = x;
+        else
+            nodes[g].right = x;
+    }
+
+    update(p);
+    update(x);
+}
+
+void DynamicTree::splay(int x)
+{
+    while (!isSplayRoot(x))
+    {
+        int p = nodes[x].parent;
+        if (!isSplayRoot(p))
+        {
+            int g = nodes[p].parent;
+            bool zigZig = (nodes[g].left == p) == (nodes[p].left == x);
+            rotate(zigZig ? p : x);
+        }
+        rotate(x);
+    }
+}
+
+/*
+Makes the root-to-v path the preferred path, with v at the root of its splay tree and no deeper
+node on it. Returns the last node where the climb joined a new path (the LCA trick in lca()).
+*/
+int DynamicTree::access(int v)
+{
+    int last = -1;
+    for (int y = v; y != -1; y = nodes[y].parent)
+    {
+        splay(y);
+        nodes[y].right = last;
+        update(y);
+        last = y;
+    }
+    splay(v);
+    return last;
+}
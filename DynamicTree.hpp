@@ -0,0 +1,104 @@
+#ifndef DYNAMICTREE_HPP
+#define DYNAMICTREE_HPP
+
+#include <vector>
+#include "CSRTree.hpp"
+
+/**
+ * Class to answer LCA and next-node-on-path queries on a forest that changes over time
+ * (new leaves, subtrees re-parented), without rebuilding anything.
+ * It is a link-cut tree: each root-to-node path last accessed is kept as a splay tree ordered by
+ * depth, so every operation and query runs in O(log n) amortized time.
+ * Queries restructure the splay trees, so unlike the static structures they are not const and
+ * an instance must not be queried from several threads at once.
+ */
+class DynamicTree
+{
+public:
+    /**
+     * Constructor. It creates n isolated nodes, each the root of its own tree.
+     */
+    DynamicTree(int n = 0);
+
+    /**
+     * Constructor. It starts from the tree given by a CSR view (only the parent links are read).
+     */
+    DynamicTree(const TreeView &tree);
+
+    /**
+     * Adds a new isolated node, root of its own tree.
+     * @return index of the new node
+     */
+    int addNode();
+
+    /**
+     * Adds a new leaf as the last child of parent.
+     * @return index of the new node
+     */
+    int addLeaf(int parent);
+
+    /**
+     * Makes v, which must be the root of its tree, a child of parent, which must be in another tree.
+     */
+    void link(int v, int parent);
+
+    /**
+     * Detaches the subtree of v from v's parent, so that v becomes the root of its own tree.
+     */
+    void cut(int v);
+
+    /**
+     * Finds the LCA between nodes i and j.
+     * @return LCA(i, j), or -1 if i and j are in different trees
+     */
+    int lca(int i, int j);
+
+    /**
+     * Finds the next node on the unique path between nodes i and j.
+     * @return next-node-on-path(i, j), or -1 if i == j or i and j are in different trees
+     */
+    int query(int i, int j);
+
+    /**
+     * Finds the parent of v, or -1 if v is a root.
+     */
+    int parent(int v);
+
+    /**
+     * Finds the depth of v within its tree (a root has depth 0).
+     */
+    int depth(int v);
+
+    /**
+     * Finds the root of the tree containing v.
+     */
+    int findRoot(int v);
+
+    /**
+     * Returns the number of nodes.
+     */
+    int size() const;
+
+private:
+    // Splay tree node. parent is either the parent in the splay tree, or, for the root of a
+    // splay tree, the path-parent: the tree parent of the shallowest node of the path (-1 for none)
+    struct Node
+    {
+        int left;
+        int right;
+        int parent;
+        int size; // number of nodes in this splay subtree
+    };
+    std::vector<Node> nodes;
+
+    void checkIndex(int v) const;
+    bool isSplayRoot(int x) const;
+    int splaySize(int x) const;
+    void update(int x);
+    void rotate(int x);
+    void splay(int x);
+    int access(int v);
+    int ancestorAtDepth(int v, int d);
+};
+
+#endif // DYNAMICTREE_HPP
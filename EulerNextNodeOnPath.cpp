@@ -0,0 +1,85 @@
+#include "EulerNextNodeOnPath.hpp"
+#include "Batch.hpp"
+#include "Parallel.hpp"
+#include <algorithm>
+
+EulerNextNodeOnPath::EulerNextNodeOnPath(const std::vector<int> &nodeVals,
+                                         const std::vector<int> &parent,
+                                         const std::vector<std::vector<int>> &children,
+                                         int root) : EulerNextNodeOnPath(CSRTree(parent, children, root).view())
+{
+}
+
+EulerNextNodeOnPath::EulerNextNodeOnPath(const TreeView &tree, int threads)
+{
+    treeLCA.eulerTour(tree, nullptr);
+    treeLCA.preprocessBlocks(threads, 0, false);
+}
+
+int EulerNextNodeOnPath::size() const
+{
+    return treeLCA.firstOccurrence.size();
+}
+
+int EulerNextNodeOnPath::query(int i, int j) const
+{
+    if (treeLCA.lca(i, j) != i) // j not in i's subtree: go up, to the node before i in the Euler Tour
+    {
+        return treeLCA.etSeq[treeLCA.firstOccurrence[i] - 1];
+    }
+    return i == j ? -1 : down(i, j);
+}
+
+/*
+For j in i's subtree (j != i), the tour between the first occurrences of i and j stays within i's
+subtree, so the last position before j's with i's depth is an occurrence of i, and the next one
+is the child whose subtree holds j.
+*/
+int EulerNextNodeOnPath::down(int i, int j) const
+{
+    int d = treeLCA.depthEtSeq[treeLCA.firstOccurrence[i]];
+    return treeLCA.etSeq[treeLCA.lastWithinDepth(treeLCA.firstOccurrence[j], d) + 1];
+}
+
+void EulerNextNodeOnPath::queryBatch(const int *src, const int *dst, int *out, size_t n, int threads) const
+{
+    validateBatchIndices(src, dst, n, size());
+
+    parallelFor(n, BATCH_THREAD_GRAIN, threads, [=](size_t begin, size_t end)
+    {
+        for (size_t q = begin; q < end; q += BATCH_TILE_SIZE)
+        {
+            queryTile(src + q, dst + q, out + q, std::min<size_t>(BATCH_TILE_SIZE, end - q));
+        }
+    });
+}
+
+/*
+Answers up to BATCH_TILE_SIZE unchecked queries: the LCAs of the whole tile are found first, then
+the parents of the upward steps are prefetched while the downward ones are searched.
+*/
+void EulerNextNodeOnPath::queryTile(const int *src, const int *dst, int *out, int n) const
+{
+    int lcas[BATCH_TILE_SIZE];
+    treeLCA.lcaTile(src, dst, lcas, n);
+
+    for (int q = 0; q < n; q++)
+    {
+        if (lcas[q] != src[q])
+        {
+            prefetch(&treeLCA.etSeq[treeLCA.firstOccurrence[src[q]] - 1]);
+        }
+    }
+
+    for (int q = 0; q < n; q++)
+    {
+        if (lcas[q] != src[q]) // j not in i's subtree: go up
+        {
+            out[q] = treeLCA.etSeq[treeLCA.firstOccurrence[src[q]] - 1];
+        }
+        else
+        {
+            out[q] = src[q] == dst[q] ? -1 : down(src[q], dst[q]);
+        }
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef EULERNEXTNODEONPATH_HPP
+#define EULERNEXTNODEONPATH_HPP
+
+#include <vector>
+#include <cstddef>
+#include "LCA.hpp"
+#include "CSRTree.hpp"
+
+/**
+ * Lighter alternative to NextNodeOnPath, which answers next-node-on-path queries from the Euler
+ * Tour of a single LCA structure, without the RMQ over post-order labels nor the per-node
+ * traversal arrays. If j is not in i's subtree, the next node is i's parent, which precedes i's
+ * first occurrence in the tour; otherwise it is the child of i that the tour enters right after
+ * the last occurrence of i before j, found like a level ancestor in O(log n) time.
+ * The LCA is also built without its per-position in-block minima, which are read from the shared
+ * in-block tables instead: the structure takes less than half the memory of NextNodeOnPath and
+ * a half to two thirds of its preprocessing time, for slower queries into deep subtrees.
+ * Queries are const and thread-safe.
+ */
+class EulerNextNodeOnPath
+{
+public:
+    /**
+     * Constructor. It takes arrays for node values, parent and child links,
+     * as well as the index of the root in nodeVals.
+     */
+    EulerNextNodeOnPath(const std::vector<int> &nodeVals,
+                        const std::vector<int> &parent,
+                        const std::vector<std::vector<int>> &children,
+                        int root);
+
+    /**
+     * Constructor. It reads the tree through a CSR view, without copying it.
+     * @param threads maximum number of preprocessing threads (0 means one per hardware thread)
+     */
+    EulerNextNodeOnPath(const TreeView &tree, int threads = 0);
+
+    /**
+     * Finds the next node on the unique path between nodes i and j.
+     * @return next-node-on-path(i, j), or -1 if i == j
+     */
+    int query(int i, int j) const;
+
+    /**
+     * Answers a batch of next-node-on-path queries: out[q] = next-node-on-path(src[q], dst[q]),
+     * or -1 when src[q] == dst[q]. Indices are validated once for the whole batch, and the LCAs
+     * are found in tiles that overlap their memory accesses, split across threads for large batches.
+     * @param threads maximum number of threads (0 means one per hardware thread)
+     */
+    void queryBatch(const int *src, const int *dst, int *out, size_t n, int threads = 0) const;
+
+    /**
+     * Returns the number of nodes.
+     */
+    int size() const;
+
+private:
+    LCA treeLCA;
+
+    int down(int i, int j) const;
+    void queryTile(const int *src, const int *dst, int *out, int n) const;
+};
+
+#endif // EULERNEXTNODEONPATH_HPP
@@ -0,0 +1,136 @@
+#include "Forest.hpp"
+#include "Batch.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+Forest::Forest(const std::vector<TreeView> &trees, int threads) : joinedTrees(joinTrees(trees, threads))
+{
+    treeOffsets.resize(trees.size() + 1, 0);
+    for (size_t t = 0; t < trees.size(); t++)
+    {
+        treeOffsets[t + 1] = treeOffsets[t] + trees[t].size;
+    }
+    nodeTree.resize(treeOffsets.back());
+    for (size_t t = 0; t < trees.size(); t++)
+    {
+        std::fill(nodeTree.begin() + treeOffsets[t], nodeTree.begin() + treeOffsets[t + 1], t);
+    }
+}
+
+// builds a single tree holding all the trees, with the virtual root as the parent of their roots
+NextNodeOnPath Forest::joinTrees(const std::vector<TreeView> &trees, int threads)
+{
+    int n = 0, maxTreeSize = 0;
+    for (const TreeView &tree : trees)
+    {
+        n += tree.size;
+        maxTreeSize = std::max(maxTreeSize, tree.size);
+    }
+
+    std::vector<int> parent(n + 1);
+    int offset = 0;
+    for (const TreeView &tree : trees)
+    {
+        for (int v = 0; v < tree.size; v++)
+        {
+            parent[offset + v] = tree.parent[v] == -1 ? n : offset + tree.parent[v];
+        }
+        offset += tree.size;
+    }
+    parent[n] = -1;
+
+    CSRTree joined(std::move(parent));
+    return NextNodeOnPath(joined.view(), threads, maxTreeSize);
+}
+
+int Forest::query(int i, int j) const
+{
+    checkIndex(i);
+    checkIndex(j);
+    if (i == j || nodeTree[i] != nodeTree[j])
+    {
+        return -1;
+    }
+
+    // within one tree, the path never reaches the virtual root
+    return joinedTrees.query(i, j);
+}
+
+int Forest::query(int tree, int i, int j) const
+{
+    checkTree(tree);
+    if (i < 0 || j < 0 || i >= treeSize(tree) || j >= treeSize(tree))
+    {
+        throw std::out_of_range("Index out of bounds.");
+    }
+    if (i == j)
+    {
+        return -1;
+    }
+    return joinedTrees.query(treeOffsets[tree] + i, treeOffsets[tree] + j) - treeOffsets[tree];
+}
+
+void Forest::queryBatch(const int *src, const int *dst, int *out, size_t n, int threads) const
+{
+    validateBatchIndices(src, dst, n, size());
+
+    // the joined tree is only preprocessed for queries within single trees: queries across
+    // trees are turned into queries from a node to itself, which give -1
+    std::vector<int> sameTreeDst(dst, dst + n);
+    for (size_t q = 0; q < n; q++)
+    {
+        if (nodeTree[src[q]] != nodeTree[dst[q]])
+        {
+            sameTreeDst[q] = src[q];
+        }
+    }
+    joinedTrees.queryBatch(src, sameTreeDst.data(), out, n, threads);
+}
+
+int Forest::globalId(int tree, int v) const
+{
+    checkTree(tree);
+    if (v < 0 || v >= treeSize(tree))
+    {
+        throw std::out_of_range("Index out of bounds.");
+    }
+    return treeOffsets[tree] + v;
+}
+
+int Forest::treeOf(int v) const
+{
+    checkIndex(v);
+    return nodeTree[v];
+}
+
+int Forest::treeSize(int tree) const
+{
+    checkTree(tree);
+    return treeOffsets[tree + 1] - treeOffsets[tree];
+}
+
+int Forest::treeCount() const
+{
+    return treeOffsets.size() - 1;
+}
+
+int Forest::size() const
+{
+    return nodeTree.size();
+}
+
+void Forest::checkIndex(int v) const
+{
+    if (v < 0 || v >= nodeTree.size())
+    {
+        throw std::out_of_range("Index out of bounds.");
+    }
+}
+
+void Forest::checkTree(int tree) const
+{
+    if (tree < 0 || tree >= treeCount())
+    {
+        throw std::out_of_range("Tree index out of bounds.");
+    }
+}
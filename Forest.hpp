@@ -0,0 +1,83 @@
+#ifndef FOREST_HPP
+#define FOREST_HPP
+
+#include <vector>
+#include <cstddef>
+#include "NextNodeOnPath.hpp"
+#include "CSRTree.hpp"
+
+/**
+ * Class to answer next-node-on-path queries on a forest of many trees with a single structure.
+ * The trees are joined under a virtual root and preprocessed together, so all of them share
+ * one Euler tour, one set of flat arrays and one in-block lookup table, instead of paying for
+ * them once per tree. Since queries never cross trees, the Sparse Tables only cover ranges as
+ * long as the largest tree, not the whole forest.
+ * Nodes have global ids: the nodes of tree t are globalId(t, 0), ..., globalId(t, treeSize(t) - 1),
+ * in order. Queries are const and thread-safe.
+ */
+class Forest
+{
+public:
+    /**
+     * Constructor. It preprocesses the trees given by CSR views (only the parent links are read).
+     * @param threads maximum number of preprocessing threads (0 means one per hardware thread)
+     */
+    Forest(const std::vector<TreeView> &trees, int threads = 0);
+
+    /**
+     * Finds the next node on the unique path between the nodes with global ids i and j.
+     * @return global id of next-node-on-path(i, j), or -1 if i == j or i and j are in different trees
+     */
+    int query(int i, int j) const;
+
+    /**
+     * Finds the next node on the unique path between nodes i and j of the given tree.
+     * @return index of next-node-on-path(i, j) in the tree, or -1 if i == j
+     */
+    int query(int tree, int i, int j) const;
+
+    /**
+     * Answers a batch of global-id queries: out[q] = query(src[q], dst[q]).
+     * @param threads maximum number of threads (0 means one per hardware thread)
+     */
+    void queryBatch(const int *src, const int *dst, int *out, size_t n, int threads = 0) const;
+
+    /**
+     * Returns the global id of node v of the given tree.
+     */
+    int globalId(int tree, int v) const;
+
+    /**
+     * Returns the tree containing the node with global id v.
+     */
+    int treeOf(int v) const;
+
+    /**
+     * Returns the number of nodes of the given tree.
+     */
+    int treeSize(int tree) const;
+
+    /**
+     * Returns the number of trees.
+     */
+    int treeCount() const;
+
+    /**
+     * Returns the total number of nodes, over all the trees.
+     */
+    int size() const;
+
+private:
+    // Tree t holds the global ids treeOffsets[t], ..., treeOffsets[t + 1] - 1;
+    // the virtual root has global id size()
+    std::vector<int> treeOffsets;
+    std::vector<int> nodeTree;
+
+    NextNodeOnPath joinedTrees; // preprocessed for queries within single trees only
+
+    static NextNodeOnPath joinTrees(const std::vector<TreeView> &trees, int threads);
+    void checkIndex(int v) const;
+    void checkTree(int tree) const;
+};
+
+#endif // FOREST_HPP
@@ -0,0 +1,201 @@
+#include "IncrementalNextNodeOnPath.hpp"
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+// builds the static structure of a whole tree, on the rebuild thread
+static std::shared_ptr<const NextNodeOnPath> buildNextNodeOnPath(std::vector<int> parent, int threads)
+{
+    CSRTree tree(std::move(parent));
+    return std::make_shared<const NextNodeOnPath>(tree.view(), threads);
+}
+
+IncrementalNextNodeOnPath::IncrementalNextNodeOnPath(const TreeView &tree, size_t rebuildThreshold, int threads)
+    : parent(tree.parent, tree.parent + tree.size),
+      rebuildSize(0),
+      rebuildThreshold(rebuildThreshold),
+      automaticThreshold(rebuildThreshold == 0),
+      threads(threads)
+{
+    if (automaticThreshold)
+    {
+        this->rebuildThreshold = std::max<size_t>(INCREMENTAL_MIN_OVERLAY, tree.size / INCREMENTAL_OVERLAY_FRACTION);
+    }
+    state = makeState(std::make_shared<const NextNodeOnPath>(tree, threads), tree.size, this->rebuildThreshold);
+}
+
+int IncrementalNextNodeOnPath::addLeaf(int p)
+{
+    if (p < 0 || p >= parent.size())
+    {
+        throw std::out_of_range("Index out of bounds.");
+    }
+    if (rebuild.valid() && rebuild.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+    {
+        installRebuild();
+    }
+
+    // the writer is the only thread replacing the state, so it reads it without synchronisation
+    if (state->overlaySize.load(std::memory_order_relaxed) == state->overlay.size())
+    {
+        std::shared_ptr<State> grown = makeState(state->base, state->baseSize, 2 * state->overlay.size());
+        int published = state->overlaySize.load(std::memory_order_relaxed);
+        std::copy(state->overlay.begin(), state->overlay.begin() + published, grown->overlay.begin());
+        grown->overlaySize.store(published, std::memory_order_relaxed);
+        std::atomic_store(&state, grown);
+    }
+    appendOverlay(*state, p);
+    parent.push_back(p);
+
+    if (!rebuild.valid() && state->overlaySize.load(std::memory_order_relaxed) >= rebuildThreshold)
+    {
+        startRebuild();
+    }
+    return parent.size() - 1;
+}
+
+int IncrementalNextNodeOnPath::query(int i, int j) const
+{
+    std::shared_ptr<const State> s = std::atomic_load(&state);
+    int n0 = s->baseSize, n = n0 + s->overlaySize.load(std::memory_order_acquire);
+    if (i < 0 || i >= n || j < 0 || j >= n)
+    {
+        throw std::out_of_range("Index out of bounds.");
+    }
+    if (i == j)
+    {
+        return -1;
+    }
+
+    if (i < n0 && j < n0)
+    {
+        return s->base->query(i, j);
+    }
+
+    if (i >= n0) // i is new: j is either in its subtree, below it in the overlay, or the path goes up
+    {
+        const OverlayNode &iNode = s->overlay[i - n0];
+        if (j >= n0 && s->overlay[j - n0].anchor == iNode.anchor && s->overlay[j - n0].depth > iNode.depth
+            && overlayAncestor(*s, j, iNode.depth) == i)
+        {
+            return overlayAncestor(*s, j, iNode.depth + 1);
+        }
+        return iNode.parent;
+    }
+
+    // i is old and j is new: the path to j goes through j's anchor
+    int anchor = s->overlay[j - n0].anchor;
+    if (anchor == i)
+    {
+        return overlayAncestor(*s, j, 1);
+    }
+    return s->base->query(i, anchor);
+}
+
+int IncrementalNextNodeOnPath::size() const
+{
+    std::shared_ptr<const State> s = std::atomic_load(&state);
+    return s->baseSize + s->overlaySize.load(std::memory_order_acquire);
+}
+
+int IncrementalNextNodeOnPath::overlaySize() const
+{
+    std::shared_ptr<const State> s = std::atomic_load(&state);
+    return s->overlaySize.load(std::memory_order_acquire);
+}
+
+void IncrementalNextNodeOnPath::waitForRebuild()
+{
+    if (rebuild.valid())
+    {
+        installRebuild();
+    }
+}
+
+std::shared_ptr<IncrementalNextNodeOnPath::State> IncrementalNextNodeOnPath::makeState(
+    std::shared_ptr<const NextNodeOnPath> base, int baseSize, size_t capacity)
+{
+    std::shared_ptr<State> s = std::make_shared<State>();
+    s->base = std::move(base);
+    s->baseSize = baseSize;
+    s->overlay.resize(std::max<size_t>(capacity, 1));
+    s->overlaySize.store(0, std::memory_order_relaxed);
+    return s;
+}
+
+/*
+Appends a leaf to an overlay with free capacity. The entry is written before the size is
+published with release semantics, so readers that see the new size also see the entry.
+*/
+void IncrementalNextNodeOnPath::appendOverlay(State &s, int p)
+{
+    int k = s.overlaySize.load(std::memory_order_relaxed);
+    OverlayNode &node = s.overlay[k];
+    node.parent = p;
+    if (p < s.baseSize)
+    {
+        node.anchor = p;
+        node.depth = 1;
+        node.jump = p;
+    }
+    else
+    {
+        // skew-binary jump pointers: jump twice as far when the parent's two jumps have equal length
+        const OverlayNode &parentNode = s.overlay[p - s.baseSize];
+        node.anchor = parentNode.anchor;
+        node.depth = parentNode.depth + 1;
+        int j = parentNode.jump;
+        if (j >= s.baseSize && parentNode.depth - overlayDepth(s, j) == overlayDepth(s, j) - overlayDepth(s, s.overlay[j - s.baseSize].jump))
+        {
+            node.jump = s.overlay[j - s.baseSize].jump;
+        }
+        else
+        {
+            node.jump = p;
+        }
+    }
+    s.overlaySize.store(k + 1, std::memory_order_release);
+}
+
+// depth below the anchor (0 for the anchor itself, which is in the static structure)
+int IncrementalNextNodeOnPath::overlayDepth(const State &s, int v)
+{
+    return v < s.baseSize ? 0 : s.overlay[v - s.baseSize].depth;
+}
+
+// finds the ancestor of the overlay node v at depth d below its anchor, 1 <= d <= depth(v)
+int IncrementalNextNodeOnPath::overlayAncestor(const State &s, int v, int d)
+{
+    while (s.overlay[v - s.baseSize].depth > d)
+    {
+        const OverlayNode &node = s.overlay[v - s.baseSize];
+        v = overlayDepth(s, node.jump) >= d ? node.jump : node.parent;
+    }
+    return v;
+}
+
+void IncrementalNextNodeOnPath::startRebuild()
+{
+    rebuildSize = parent.size();
+    rebuild = std::async(std::launch::async, buildNextNodeOnPath, parent, threads);
+}
+
+/*
+Waits for the rebuild and swaps in its result: the leaves appended while it was running are
+replayed into the overlay of the new state, which then replaces the old one atomically.
+*/
+void IncrementalNextNodeOnPath::installRebuild()
+{
+    std::shared_ptr<const NextNodeOnPath> base = rebuild.get();
+    if (automaticThreshold)
+    {
+        rebuildThreshold = std::max<size_t>(INCREMENTAL_MIN_OVERLAY, rebuildSize / INCREMENTAL_OVERLAY_FRACTION);
+    }
+
+    std::shared_ptr<State> rebuilt = makeState(std::move(base), rebuildSize, std::max<size_t>(rebuildThreshold, 2 * (parent.size() - rebuildSize)));
+    for (int v = rebuildSize; v < parent.size(); v++)
+    {
+        appendOverlay(*rebuilt, parent[v]);
+    }
+    std::atomic_store(&state, rebuilt);
+}
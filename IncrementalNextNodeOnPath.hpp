@@ -0,0 +1,107 @@
+#ifndef INCREMENTALNEXTNODEONPATH_HPP
+#define INCREMENTALNEXTNODEONPATH_HPP
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <future>
+#include <cstddef>
+#include "NextNodeOnPath.hpp"
+#include "CSRTree.hpp"
+
+// Smallest overlay that triggers a rebuild, when the threshold is automatic
+#define INCREMENTAL_MIN_OVERLAY 1024
+
+// With an automatic threshold, a rebuild starts once the overlay holds 1/INCREMENTAL_OVERLAY_FRACTION
+// of the nodes of the static structure, so rebuilds cost O(1) amortized time per appended leaf
+#define INCREMENTAL_OVERLAY_FRACTION 8
+
+/**
+ * Class to answer next-node-on-path queries on a tree that grows by appending leaves.
+ * Queries between nodes of the last static NextNodeOnPath are answered by it; new leaves are
+ * kept in a small overlay with jump pointers, through which the other queries are reduced to
+ * a query on the static structure plus an O(log k) level ancestor walk (k = overlay size).
+ * Once the overlay reaches the rebuild threshold, a new static NextNodeOnPath over the whole
+ * tree is built on a background thread, while leaves keep being appended to the overlay;
+ * it is swapped in atomically by the next addLeaf (or by waitForRebuild).
+ * query is const and thread-safe, and never waits for a rebuild: it can run concurrently
+ * with addLeaf, which must be called from a single thread.
+ */
+class IncrementalNextNodeOnPath
+{
+public:
+    /**
+     * Constructor. It preprocesses the initial tree given by a CSR view.
+     * @param rebuildThreshold overlay size that triggers a rebuild (0 means automatic)
+     * @param threads maximum number of threads of each rebuild (0 means one per hardware thread)
+     */
+    IncrementalNextNodeOnPath(const TreeView &tree, size_t rebuildThreshold = 0, int threads = 0);
+
+    /**
+     * Adds a new leaf as a child of parent, in O(1) amortized time.
+     * @return index of the new node
+     */
+    int addLeaf(int parent);
+
+    /**
+     * Finds the next node on the unique path between nodes i and j.
+     * @return next-node-on-path(i, j), or -1 if i == j
+     */
+    int query(int i, int j) const;
+
+    /**
+     * Returns the number of nodes.
+     */
+    int size() const;
+
+    /**
+     * Returns the number of nodes in the overlay, not yet covered by the static structure.
+     */
+    int overlaySize() const;
+
+    /**
+     * Waits for the running rebuild, if any, and swaps in its result.
+     */
+    void waitForRebuild();
+
+private:
+    // A leaf appended after the static structure was built. anchor is its deepest ancestor in the
+    // static structure, depth its distance from the anchor, and jump a skew-binary jump pointer
+    // to an ancestor (or the anchor) used for level ancestor walks.
+    struct OverlayNode
+    {
+        int parent;
+        int anchor;
+        int depth;
+        int jump;
+    };
+
+    // A static structure with the overlay of the leaves appended after it. The overlay never
+    // reallocates: it is copied into a new State when full, so readers of an old State are unaffected.
+    struct State
+    {
+        std::shared_ptr<const NextNodeOnPath> base;
+        int baseSize;
+        std::vector<OverlayNode> overlay; // capacity entries, of which overlaySize are published
+        std::atomic<int> overlaySize;
+    };
+
+    std::shared_ptr<State> state; // read with std::atomic_load, replaced with std::atomic_store
+
+    // Writer-side data: the parents of all the nodes, and the running rebuild
+    std::vector<int> parent;
+    std::future<std::shared_ptr<const NextNodeOnPath>> rebuild;
+    int rebuildSize;
+    size_t rebuildThreshold;
+    bool automaticThreshold;
+    int threads;
+
+    static std::shared_ptr<State> makeState(std::shared_ptr<const NextNodeOnPath> base, int baseSize, size_t capacity);
+    static void appendOverlay(State &s, int parent);
+    static int overlayDepth(const State &s, int v);
+    static int overlayAncestor(const State &s, int v, int d);
+    void startRebuild();
+    void installRebuild();
+};
+
+#endif // INCREMENTALNEXTNODEONPATH_HPP
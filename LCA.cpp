@@ -1,24 +1,30 @@
 #include "LCA.hpp"
+#include "Batch.hpp"
+#include "Parallel.hpp"
+#include "Snapshot.hpp"
+#include "BlockKernels.hpp"
 #include <stdexcept>
+#include <algorithm>
 #include <cmath>
+#include <utility>
 
 LCA::LCA(const std::vector<int> &nodeVals,
          const std::vector<int> &parent,
          const std::vector<std::vector<int>> &children,
-         int root) : nodeVals(nodeVals),
-                     parent(parent),
-                     children(children),
-                     root(root)
+         int root,
+         Traversals *traversals) : LCA(CSRTree(parent, children, root).view(), traversals)
 {
-    preprocessForLCA();
 }
 
-int LCA::lca(int i, int j)
+LCA::LCA(const TreeView &tree, Traversals *traversals, int threads)
 {
-    if (i < 0 || j < 0 || i >= nodeVals.size() || j >= nodeVals.size())
-    {
-        throw std::out_of_range("Index out of bounds.");
-    }
+    preprocessForLCA(tree, traversals, threads);
+}
+
+int LCA::lca(int i, int j) const
+{
+    checkIndex(i);
+    checkIndex(j);
 
     // convert i, j to their first occurrence within euler tour
     i = firstOccurrence[i];
@@ -28,189 +34,531 @@ int LCA::lca(int i, int j)
     if (j < i)
         std::swap(i, j);
 
-    int iBlock = i / blockSize, jBlock = j / blockSize;
+    return etSeq[minPosition(i, j)];
+}
 
-    int resIndex;
-    if (iBlock != jBlock) // first case: i and j not in the same block
+/*
+Finds the position of min depth over the Euler Tour positions i...j, with i <= j, with the kernel
+compiled for the block size of this instance: block indices and offsets are then shifts and masks
+by a constant.
+*/
+int LCA::minPosition(int i, int j) const
+{
+    switch (blockBits)
     {
-        resIndex = minByDepth(suffixMinIndex[i], prefixMinIndex[j]);
-        if (jBlock > iBlock + 1) // there are whole blocks in between
-        {
-            resIndex = minByDepth(resIndex, blockRangeRMQ(iBlock + 1, jBlock - 1));
-        }
+    case 0:
+        return minPositionFixed<0>(i, j);
+    case 1:
+        return minPositionFixed<1>(i, j);
+    case 2:
+        return minPositionFixed<2>(i, j);
+    default:
+        return minPositionFixed<LCA_MAX_BLOCK_BITS>(i, j);
     }
-    else // second case: i and j within single block
+}
+
+template <int BLOCK_BITS>
+int LCA::minPositionFixed(int i, int j) const
+{
+    int candidates[4];
+    rangeCandidates<BLOCK_BITS>(i, j, candidates);
+    return minByDepth(minByDepth(candidates[0], candidates[1]), minByDepth(candidates[2], candidates[3]));
+}
+
+/*
+Gathers the four candidates for the min over the Euler Tour positions i...j, with i <= j, without
+branching on where they fall: the head of the range (the tail of i's block, or i...j itself within
+a single block), the prefix of j's block up to j, and the two overlapping Sparse Table windows over
+the whole blocks in between. The entries of the cases that do not apply are still read, at clamped
+indices, and then replaced by the head, so that a stream mixing near and far queries does not
+mispredict.
+*/
+template <int BLOCK_BITS>
+void LCA::rangeCandidates(int i, int j, int candidates[4]) const
+{
+    const int offsetMask = (1 << BLOCK_BITS) - 1;
+    int iBlock = i >> BLOCK_BITS, jBlock = j >> BLOCK_BITS;
+    bool sameBlock = iBlock == jBlock, blocksBetween = jBlock > iBlock + 1;
+
+    // only j's block can be partial, so the head ends at j or at the end of a whole block
+    int headEnd = sameBlock ? j & offsetMask : offsetMask;
+    int head = (iBlock << BLOCK_BITS) + MIN[(blockBinaryString[iBlock] << 2 * BLOCK_BITS) + ((i & offsetMask) << BLOCK_BITS) + headEnd];
+    int tail = prefixMinIndex.empty() ? (jBlock << BLOCK_BITS) + MIN[(blockBinaryString[jBlock] << 2 * BLOCK_BITS) + (j & offsetMask)]
+                                      : prefixMinIndex[j];
+
+    // the whole blocks k...l in between, or block 0 alone when there are none
+    int k = blocksBetween ? iBlock + 1 : 0, l = blocksBetween ? jBlock - 1 : 0;
+    int e = 31 - __builtin_clz(l - k + 1);
+    const int *windows = pow2Windows[e].data();
+    int first = windows[k], second = windows[l + 1 - (1 << e)];
+
+    candidates[0] = head;
+    candidates[1] = sameBlock ? head : tail;
+    candidates[2] = blocksBetween ? first : head;
+    candidates[3] = blocksBetween ? second : head;
+}
+
+void LCA::checkIndex(int v) const
+{
+    if (v < 0 || v >= firstOccurrence.size())
     {
-        resIndex = singleBlockRMQ(iBlock, i % blockSize, j % blockSize);
+        throw std::out_of_range("Index out of bounds.");
     }
+}
 
-    return etSeq[resIndex];
+int LCA::depth(int v) const
+{
+    checkIndex(v);
+    return depthEtSeq[firstOccurrence[v]];
 }
 
-int LCA::singleBlockRMQ(int block, int i, int j)
+int LCA::distance(int i, int j) const
 {
-    int minWithinBlockIndex = MIN[blockBinaryString[block]][i][j];
-    return block * blockSize + minWithinBlockIndex;
+    return depth(i) + depth(j) - 2 * depth(lca(i, j));
 }
 
 /*
-Computes the min across a range of whole blocks. Returns the index within the ET
+The ancestor of v at depth d is the node at the last position of the Euler Tour, before v's first
+occurrence, with depth <= d: after that position the tour stays within the ancestor's subtree.
 */
-int LCA::blockRangeRMQ(int k, int l)
+int LCA::levelAncestor(int v, int d) const
 {
-    // trivial case: the range is a single block
-    if (k == l)
+    checkIndex(v);
+    int pos = firstOccurrence[v];
+    if (d < 0 || d > depthEtSeq[pos])
     {
-        return blockMinIndex[k];
+        throw std::out_of_range("Depth out of bounds.");
     }
+    return etSeq[lastWithinDepth(pos, d)];
+}
 
-    // exponent for next-smallest power of two less than the range size
-    int e = floor(log2(l - k + 1));
-    int windowSize = 1 << e; // 2^e
+/*
+Finds the last position of the Euler Tour up to pos with depth <= d, for d >= 0. It is searched in
+pos's own block first, then in the nearest block to the left whose min is small enough, found by
+skipping power-of-two windows of the Sparse Table.
+*/
+int LCA::lastWithinDepth(int pos, int d) const
+{
+    // scan pos's block, up to pos
+    int block = pos >> blockBits;
+    if (depthEtSeq[prefixMin(pos)] <= d)
+    {
+        for (int p = pos; ; p--)
+        {
+            if (depthEtSeq[p] <= d)
+                return p;
+        }
+    }
 
-    return minByDepth(pow2Windows[e - 1][k], pow2Windows[e - 1][l + 1 - windowSize]);
+    // skip the blocks to the left whose min is deeper than d: windows of doubling size first,
+    // until one holds a small enough min, then windows of halving size within the last one;
+    // block 0 starts at the root, so the search always stops
+    int r = block - 1, e = 0;
+    while (e < (int)pow2Windows.size() && r - (1 << e) + 1 >= 0 && depthEtSeq[pow2Windows[e][r - (1 << e) + 1]] > d)
+    {
+        r -= 1 << e;
+        e++;
+    }
+    for (e--; e >= 0; e--)
+    {
+        int start = r - (1 << e) + 1;
+        if (start >= 0 && depthEtSeq[pow2Windows[e][start]] > d)
+            r = start - 1;
+    }
+
+    // scan block r from its end
+    for (int p = ((r + 1) << blockBits) - 1; ; p--)
+    {
+        if (depthEtSeq[p] <= d)
+            return p;
+    }
 }
 
-void LCA::preprocessForLCA()
+void LCA::lcaBatch(const int *src, const int *dst, int *out, size_t n, int threads) const
 {
-    // Perform Euler Tour of the input tree
-    eulerTour();
+    validateBatchIndices(src, dst, n, firstOccurrence.size());
 
-    blockSize = floor(log2(depthEtSeq.size()));
+    parallelFor(n, BATCH_THREAD_GRAIN, threads, [=](size_t begin, size_t end)
+    {
+        for (size_t q = begin; q < end; q += BATCH_TILE_SIZE)
+        {
+            lcaTile(src + q, dst + q, out + q, std::min<size_t>(BATCH_TILE_SIZE, end - q));
+        }
+    });
+}
 
-    // Build vectors prefixMinIndex, suffixMinIndex and blockMinIndex
-    prefixMinIndex.resize(depthEtSeq.size());
-    suffixMinIndex.resize(depthEtSeq.size());
-    blockMinIndex.resize(depthEtSeq.size() / blockSize); 
+/*
+Answers up to BATCH_TILE_SIZE unchecked LCA queries, with the kernel compiled for the block size of
+this instance (see minPosition())
+*/
+void LCA::lcaTile(const int *src, const int *dst, int *out, int n) const
+{
+    switch (blockBits)
+    {
+    case 0:
+        return lcaTileFixed<0>(src, dst, out, n);
+    case 1:
+        return lcaTileFixed<1>(src, dst, out, n);
+    case 2:
+        return lcaTileFixed<2>(src, dst, out, n);
+    default:
+        return lcaTileFixed<LCA_MAX_BLOCK_BITS>(src, dst, out, n);
+    }
+}
 
-    int pMinIndex = 0, sMinIndex = depthEtSeq.size() - 1;
-    prefixMinIndex[0] = pMinIndex;
-    suffixMinIndex[depthEtSeq.size() - 1] = sMinIndex;
+/*
+Answers the queries of a tile one stage at a time across the whole tile: each stage prefetches what
+the next one reads, so that the cache misses of the tile overlap.
+*/
+template <int BLOCK_BITS>
+void LCA::lcaTileFixed(const int *src, const int *dst, int *out, int n) const
+{
+    int lo[BATCH_TILE_SIZE], hi[BATCH_TILE_SIZE]; // ordered Euler Tour positions of the query nodes
+    int candidates[BATCH_TILE_SIZE][4], resIndex[BATCH_TILE_SIZE];
 
-    for (int i = 1; i < depthEtSeq.size(); i++)
+    for (int q = 0; q < n; q++)
     {
-        pMinIndex = minByDepth(pMinIndex, i);
-        prefixMinIndex[i] = pMinIndex;
+        prefetch(&firstOccurrence[src[q]]);
+        prefetch(&firstOccurrence[dst[q]]);
+    }
 
-        if ((i + 1) % blockSize == 0)
+    // convert to first occurrences, and prefetch the block-level entries of the candidates
+    for (int q = 0; q < n; q++)
+    {
+        int i = firstOccurrence[src[q]], j = firstOccurrence[dst[q]];
+        if (j < i)
+            std::swap(i, j);
+        lo[q] = i;
+        hi[q] = j;
+
+        int iBlock = i >> BLOCK_BITS, jBlock = j >> BLOCK_BITS;
+        prefetch(&blockBinaryString[iBlock]);
+        if (prefixMinIndex.empty())
+            prefetch(&blockBinaryString[jBlock]);
+        else
+            prefetch(&prefixMinIndex[j]);
+        if (jBlock > iBlock + 1)
         {
-            blockMinIndex[i / blockSize] = pMinIndex;
-            pMinIndex = i + 1;
+            int e = 31 - __builtin_clz(jBlock - iBlock - 1);
+            prefetch(&pow2Windows[e][iBlock + 1]);
+            prefetch(&pow2Windows[e][jBlock - (1 << e)]);
         }
+    }
 
-        if ((depthEtSeq.size() - i) % blockSize == 0)
+    // gather the candidate minima, and prefetch their depths
+    for (int q = 0; q < n; q++)
+    {
+        rangeCandidates<BLOCK_BITS>(lo[q], hi[q], candidates[q]);
+        for (int c = 0; c < 4; c++)
         {
-            sMinIndex = depthEtSeq.size() - i - 1;
+            prefetch(&depthEtSeq[candidates[q][c]]);
         }
-
-        sMinIndex = minByDepth(sMinIndex, depthEtSeq.size() - 1 - i);
-        suffixMinIndex[depthEtSeq.size() - 1 - i] = sMinIndex;
     }
 
-    // Build Sparse Table (power-of-two sized windows) on top of the blockMinIndex array
-    int levels = floor(log2(blockMinIndex.size()));
-    pow2Windows.resize(levels);
+    // pick the candidate of minimum depth, and prefetch the corresponding node
+    for (int q = 0; q < n; q++)
+    {
+        resIndex[q] = minByDepth(minByDepth(candidates[q][0], candidates[q][1]),
+                                 minByDepth(candidates[q][2], candidates[q][3]));
+        prefetch(&etSeq[resIndex[q]]);
+    }
 
-    // Compute first size-2 window array directly from blockMinIndex
-    pow2Windows[0].resize(blockMinIndex.size() - 1);
-    for (int i = 0; i < pow2Windows[0].size(); i++)
+    for (int q = 0; q < n; q++)
     {
-        pow2Windows[0][i] = minByDepth(blockMinIndex[i], blockMinIndex[i + 1]);
+        out[q] = etSeq[resIndex[q]];
     }
+}
+
+void LCA::preprocessForLCA(const TreeView &tree, Traversals *traversals, int threads)
+{
+    // Perform Euler Tour of the input tree
+    eulerTour(tree, traversals);
 
-    // Compute subsequent arrays one level at a time
-    for (int j = 2; j <= levels; j++)
+    preprocessBlocks(threads);
+}
+
+/*
+Builds the block-level data over the Euler Tour. Blocks are independent of each other, and so are
+the windows within each level of the Sparse Table, so both are split across threads.
+If maxSpan > 0, queries are only made between nodes whose first occurrences are less than maxSpan
+apart (as within the trees of a Forest), so the Sparse Table stops at windows of that length.
+Without inBlockArrays, the in-block prefix and suffix minima are not expanded into per-position
+arrays but looked up in MIN by each query, which saves 4 ints per node of the tree.
+The per-element work runs in the kernels of BlockKernels.hpp, vectorised where the CPU allows.
+*/
+void LCA::preprocessBlocks(int threads, int maxSpan, bool inBlockArrays)
+{
+    // blocks of (log n) / 2 elements, rounded down to a power of two, keep the in-block table at
+    // 8 KB or less, so that it stays in cache. From 2^16 positions on they are 8 elements, so the
+    // Sparse Table takes about log2(n / 8) / 2 bytes per position: 25 bytes per node at 10^8 nodes,
+    // against 12 with 16-element blocks and their 8 MB table
+    int size = depthEtSeq.size();
+    blockBits = std::min(LCA_MAX_BLOCK_BITS, std::max(0, (int)floor(log2(std::max(1.0, log2(size) / 2)))));
+    blockSize = 1 << blockBits;
+
+    // Build vectors prefixMinIndex, suffixMinIndex and the block minima (level 0 of the Sparse
+    // Table), as well as the binary string of each block from its +/-1 depth changes, encoded as an int
+    int blocks = (size + blockSize - 1) >> blockBits;
+    int wholeBlocks = size >> blockBits;
+    prefixMinIndex.resize(inBlockArrays ? size : 0);
+    suffixMinIndex.resize(inBlockArrays ? size : 0);
+    int levels = floor(log2(std::max(1, wholeBlocks)));
+    if (maxSpan > 0)
     {
-        int windowSize = 1 << j; // 2^j
-        pow2Windows[j - 1].resize(blockMinIndex.size() - windowSize + 1);
-        for (int i = 0; i < pow2Windows[j - 1].size(); i++)
-        {
-            pow2Windows[j - 1][i] = minByDepth(pow2Windows[j - 2][i], pow2Windows[j - 2][i + windowSize / 2]);
-        }
+        levels = std::min(levels, (int)floor(log2(std::max(1, maxSpan >> blockBits))));
     }
+    pow2Windows.resize(levels + 1);
+    Array<int> &blockMinIndex = pow2Windows[0];
+    blockMinIndex.resize(wholeBlocks);
+    blockBinaryString.assign(wholeBlocks + 1, 0);
+    const InBlockTables &tables = inBlockTables(blockSize);
+    MIN = tables.MIN.data();
+    SimdLevel simd = detectSimdLevel();
+
+    // mark the +1 depth steps, 64 positions per word: each block binary string is a run of these bits
+    std::vector<uint64_t> upSteps((size + 63) / 64);
+    parallelFor(upSteps.size(), PREPROCESS_THREAD_GRAIN / 64, threads, [&](size_t firstWord, size_t lastWord)
+    {
+        upStepBits(depthEtSeq.data(), size, firstWord, lastWord, upSteps.data(), simd);
+    });
 
-    // for each block, compute its binary string from the +/-1 depth changes;
-    // this binary string is encoded as an int;
-    // blockBinaryString[b] contains the binary string for block b
-    blockBinaryString.assign(blockMinIndex.size() + 1, 0);
-    int maxBinaryString = 0;
-    int b = 0, i = 0, j = 0;
-    while (i < etSeq.size())
+    parallelFor(blocks, PREPROCESS_THREAD_GRAIN / blockSize, threads, [&](size_t firstBlock, size_t lastBlock)
     {
-        if (j == blockSize)
+        for (int b = firstBlock; b < lastBlock; b++)
         {
-            j = 1;
-            b++;
-            i++;
-            continue;
+            // bit t - 1 of the string is the step into offset t, from position b * blockSize + t - 1
+            size_t pos = (size_t)b << blockBits, word = pos / 64;
+            int shift = pos % 64;
+            uint64_t bits = upSteps[word] >> shift;
+            if (shift + blockSize - 1 > 64 && word + 1 < upSteps.size())
+            {
+                bits |= upSteps[word + 1] << (64 - shift);
+            }
+            blockBinaryString[b] = bits & ((1u << (blockSize - 1)) - 1);
         }
-        if (j > 0 && depthEtSeq[i] == depthEtSeq[i - 1] + 1) // depth increases by 1
+
+        // the minima of whole blocks are looked up in the in-block tables
+        size_t lastWholeBlock = std::min<size_t>(lastBlock, wholeBlocks);
+        if (!inBlockArrays)
         {
-            blockBinaryString[b] += 1 << (j - 1); // add '1' corresponding to 2^(j-1)
-            maxBinaryString = std::max(maxBinaryString, blockBinaryString[b]);
+            for (size_t b = firstBlock; b < lastWholeBlock; b++)
+            {
+                blockMinIndex[b] = (b << blockBits) + MIN[(blockBinaryString[b] << 2 * blockBits) + blockSize - 1];
+            }
         }
-        i++;
-        j++;
-    }
-
-    // precompute MIN table (only for block binary strings that are actually present)
-    MIN.resize(maxBinaryString + 1);
-    for (int b = 0; b < blockBinaryString.size(); b++)
-    {
-        if (!MIN[blockBinaryString[b]].empty()) // sub-table already built
+        else if (firstBlock < lastWholeBlock)
         {
-            continue;
+            expandBlockMinima(blockBinaryString.data(), firstBlock, lastWholeBlock, blockSize, tables,
+                              prefixMinIndex.data(), suffixMinIndex.data(), blockMinIndex.data(), simd);
         }
 
-        MIN[blockBinaryString[b]].assign(blockSize, std::vector<int>(blockSize));
-        for (int i = 0; i < blockSize; i++)
+        // a partial last block is scanned
+        if (inBlockArrays && lastBlock > wholeBlocks)
         {
-            MIN[blockBinaryString[b]][i][i] = i;
-            for (int j = i + 1; j < blockSize; j++)
+            int start = wholeBlocks << blockBits, end = size;
+            int pMinIndex = start;
+            for (int i = start; i < end; i++)
             {
-                MIN[blockBinaryString[b]][i][j] = MIN[blockBinaryString[b]][i][j - 1];
-                if (b * blockSize + j < etSeq.size())
-                {
-                    MIN[blockBinaryString[b]][i][j] = minByDepth(b * blockSize + MIN[blockBinaryString[b]][i][j],
-                                                                 b * blockSize + j) -
-                                                      b * blockSize;
-                }
+                pMinIndex = minByDepth(pMinIndex, i);
+                prefixMinIndex[i] = pMinIndex;
             }
+            int sMinIndex = end - 1;
+            for (int i = end - 1; i >= start; i--)
+            {
+                sMinIndex = minByDepth(sMinIndex, i);
+                suffixMinIndex[i] = sMinIndex;
+            }
+        }
+    });
+
+    // Build the upper levels of the Sparse Table (power-of-two sized windows) on top of the block minima
+
+    // each level is built from the previous one, carrying the depths of the window minima along
+    // with their indices, so that the kernels only make contiguous loads
+    std::vector<int> depths(wholeBlocks), nextDepths(wholeBlocks);
+    parallelFor(wholeBlocks, PREPROCESS_THREAD_GRAIN, threads, [&](size_t begin, size_t end)
+    {
+        for (size_t b = begin; b < end; b++)
+        {
+            depths[b] = depthEtSeq[blockMinIndex[b]];
         }
+    });
+    const int *previous = blockMinIndex.data();
+    for (int j = 1; j <= levels; j++)
+    {
+        size_t half = (size_t)1 << (j - 1); // windows of 2^j blocks, from two of the previous level
+        Array<int> &level = pow2Windows[j];
+        level.resize(wholeBlocks - 2 * half + 1);
+        parallelFor(level.size(), PREPROCESS_THREAD_GRAIN, threads, [&](size_t begin, size_t end)
+        {
+            sparseTableLevel(previous, depths.data(), begin, end, half, level.data(), nextDepths.data(), simd);
+        });
+        depths.swap(nextDepths);
+        previous = level.data();
     }
 }
 
 // finds which index (i or j) corresponds to the minimum depth within the euler tour
-int LCA::minByDepth(int i, int j)
+int LCA::minByDepth(int i, int j) const
 {
     return depthEtSeq[i] < depthEtSeq[j] ? i : j;
 }
 
-void LCA::dfs(int root, int d)
+// index of the min over the prefix of p's block ending at p
+int LCA::prefixMin(int p) const
 {
-    firstOccurrence[root] = etSeq.size();
-    etSeq.push_back(root);
-    depth[root] = d;
+    if (!prefixMinIndex.empty())
+    {
+        return prefixMinIndex[p];
+    }
+    int block = p >> blockBits;
+    return (block << blockBits) + MIN[(blockBinaryString[block] << 2 * blockBits) + (p & (blockSize - 1))];
+}
 
-    for (int child : children[root]) // left to right
+// index of the min over the suffix of p's block starting at p (the last block may be partial)
+int LCA::suffixMin(int p) const
+{
+    if (!suffixMinIndex.empty())
     {
-        dfs(child, d + 1);
-        etSeq.push_back(root);
+        return suffixMinIndex[p];
     }
+    int block = p >> blockBits, start = block << blockBits;
+    int last = std::min(blockSize, (int)depthEtSeq.size() - start) - 1;
+    return start + MIN[(blockBinaryString[block] << 2 * blockBits) + ((p - start) << blockBits) + last];
 }
 
-void LCA::eulerTour()
+/*
+Builds the Euler Tour with an explicit stack, so that deep trees do not overflow the call stack.
+The same pass also collects the pre-order and post-order traversals, if requested.
+*/
+void LCA::eulerTour(const TreeView &tree, Traversals *traversals)
 {
-    depth.assign(nodeVals.size(), 0);
-    firstOccurrence.assign(nodeVals.size(), -1);
+    firstOccurrence.assign(tree.size, -1);
     etSeq.clear();
+    depthEtSeq.clear();
+    etSeq.reserve(2 * tree.size - 1);
+    depthEtSeq.reserve(2 * tree.size - 1);
+
+    if (traversals)
+    {
+        traversals->preOrder.clear();
+        traversals->postOrder.clear();
+        traversals->preOrder.reserve(tree.size);
+        traversals->postOrder.reserve(tree.size);
+    }
+
+    // stack of (node, position in tree.childList of the next child to visit);
+    // the depth of a node is its position in the stack
+    std::vector<std::pair<int, int>> stack;
 
-    dfs(root, 0);
+    firstOccurrence[tree.root] = 0;
+    etSeq.push_back(tree.root);
+    depthEtSeq.push_back(0);
+    if (traversals)
+        traversals->preOrder.push_back(tree.root);
+    stack.push_back(std::make_pair(tree.root, tree.childOffsets[tree.root]));
 
-    depthEtSeq.resize(etSeq.size());
+    while (!stack.empty())
+    {
+        int node = stack.back().first;
+        int nextChild = stack.back().second;
 
-    for (int i = 0; i < etSeq.size(); i++)
+        if (nextChild < tree.childOffsets[node + 1]) // descend into the next child, left to right
+        {
+            stack.back().second++;
+            int child = tree.childList[nextChild];
+            firstOccurrence[child] = etSeq.size();
+            etSeq.push_back(child);
+            depthEtSeq.push_back(stack.size());
+            if (traversals)
+                traversals->preOrder.push_back(child);
+            stack.push_back(std::make_pair(child, tree.childOffsets[child]));
+        }
+        else // all children visited: go back up to the parent
+        {
+            stack.pop_back();
+            if (traversals)
+                traversals->postOrder.push_back(node);
+            if (!stack.empty())
+            {
+                etSeq.push_back(stack.back().first);
+                depthEtSeq.push_back(stack.size() - 1);
+            }
+        }
+    }
+}
+
+void LCA::save(const std::string &path) const
+{
+    SnapshotWriter writer(SNAPSHOT_LCA);
+    writeState(writer);
+    writer.save(path);
+}
+
+LCA LCA::load(const std::string &path, bool verifyChecksums)
+{
+    SnapshotReader reader(path, SNAPSHOT_LCA, verifyChecksums);
+    LCA lca;
+    lca.readState(reader);
+    return lca;
+}
+
+// writes every array needed by queries, in the order readState() expects them
+void LCA::writeState(SnapshotWriter &writer) const
+{
+    writer.writeValue<int32_t>(blockBits);
+    writer.writeValue<uint32_t>(pow2Windows.size());
+    writer.write(etSeq);
+    writer.write(depthEtSeq);
+    writer.write(firstOccurrence);
+    writer.write(prefixMinIndex);
+    writer.write(suffixMinIndex);
+    for (const Array<int> &level : pow2Windows)
+    {
+        writer.write(level);
+    }
+    writer.write(blockBinaryString);
+}
+
+void LCA::readState(SnapshotReader &reader)
+{
+    blockBits = reader.readValue<int32_t>();
+    if (blockBits < 0 || blockBits > LCA_MAX_BLOCK_BITS)
+    {
+        throw std::runtime_error("Snapshot has an invalid LCA block size.");
+    }
+    blockSize = 1 << blockBits;
+    uint32_t levels = reader.readValue<uint32_t>();
+    if (levels == 0 || levels > 32)
+    {
+        throw std::runtime_error("Snapshot has an invalid number of LCA Sparse Table levels.");
+    }
+    pow2Windows.resize(levels);
+    reader.read(etSeq);
+    reader.read(depthEtSeq);
+    reader.read(firstOccurrence);
+    reader.read(prefixMinIndex);
+    reader.read(suffixMinIndex);
+    for (Array<int> &level : pow2Windows)
+    {
+        reader.read(level);
+    }
+    reader.read(blockBinaryString);
+    MIN = inBlockTables(blockSize).MIN.data();
+
+    // the array lengths must be those preprocessBlocks() gives the Euler Tour of firstOccurrence.size()
+    // nodes, so that queries stay within them; their contents are only covered by the checksums
+    size_t size = etSeq.size(), wholeBlocks = size >> blockBits;
+    bool consistent = !firstOccurrence.empty() && size == 2 * firstOccurrence.size() - 1 && depthEtSeq.size() == size &&
+                      prefixMinIndex.size() == suffixMinIndex.size() && (prefixMinIndex.empty() || prefixMinIndex.size() == size) &&
+                      blockBinaryString.size() == wholeBlocks + 1 && pow2Windows[0].size() == wholeBlocks &&
+                      levels == (uint32_t)floor(log2(std::max<size_t>(1, wholeBlocks))) + 1;
+    for (uint32_t e = 1; consistent && e < levels; e++)
+    {
+        consistent = pow2Windows[e].size() == wholeBlocks - ((size_t)1 << e) + 1;
+    }
+    if (!consistent)
     {
-        depthEtSeq[i] = depth[etSeq[i]];
+        throw std::runtime_error("Snapshot has inconsistent LCA array lengths.");
     }
 }
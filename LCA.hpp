@@ -2,24 +2,64 @@
 #define LCA_HPP
 
 #include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include "CSRTree.hpp"
+#include "Array.hpp"
+
+// Blocks of at most 2^3 = 8 positions, so that their in-block table (8 KB) stays in the L1 cache.
+// Blocks of (log n) / 2 positions, rounded down to a power of two, never exceed it for an
+// int-indexed Euler Tour
+#define LCA_MAX_BLOCK_BITS 3
+
+class SnapshotWriter;
+class SnapshotReader;
+
+/**
+ * Pre-order and post-order traversals of a tree (sequences of node indices),
+ * optionally collected by LCA during the same pass that builds the Euler Tour.
+ */
+struct Traversals
+{
+    std::vector<int> preOrder;
+    std::vector<int> postOrder;
+};
 
 /**
  * Class to perform Lowest Common Ancestor (LCA) queries on a tree in O(1) time, after
  * O(n) space and time preprocessing.
  * The LCA problem is solved by reduction to a simplified "+/-1 RMQ" problem
  * over the depth Euler Tour of the tree.
+ * Queries are const and never modify the structure, so a single instance can be shared by
+ * any number of querying threads without locking.
  */
 class LCA
 {
+    friend class NextNodeOnPath;
+    friend class EulerNextNodeOnPath;
+
 public:
     /**
      * Constructor. It takes arrays for node values, parent and child links,
      * as well as the index of the root in nodeVals.
+     * If traversals is not null, it is filled with the pre-order and post-order
+     * traversals of the tree.
      */
     LCA(const std::vector<int> &nodeVals,
         const std::vector<int> &parent,
         const std::vector<std::vector<int>> &children,
-        int root);
+        int root,
+        Traversals *traversals = nullptr);
+
+    /**
+     * Constructor. It reads the tree through a CSR view, without copying it:
+     * the view is only accessed during preprocessing.
+     * If traversals is not null, it is filled with the pre-order and post-order
+     * traversals of the tree.
+     * @param threads maximum number of preprocessing threads (0 means one per hardware thread)
+     */
+    LCA(const TreeView &tree, Traversals *traversals = nullptr, int threads = 0);
 
     /**
      * Default empty constructor.
@@ -32,38 +72,86 @@ public:
      * @param j index of second node in nodeVals
      * @return LCA(i, j) (index in nodeVals)
      */
-    int lca(int i, int j);
+    int lca(int i, int j) const;
 
-protected:
-    // Tree representation
-    std::vector<int> nodeVals;
-    std::vector<int> parent;
-    std::vector<std::vector<int>> children;
-    int root;
+    /**
+     * Finds the LCAs of a batch of node pairs: out[q] = LCA(src[q], dst[q]).
+     * Indices are validated once for the whole batch; queries are then answered
+     * without further checks, in tiles that overlap their memory accesses,
+     * and split across threads for large batches.
+     * @param threads maximum number of threads (0 means one per hardware thread)
+     */
+    void lcaBatch(const int *src, const int *dst, int *out, size_t n, int threads = 0) const;
 
-    void preprocessForLCA();
+    /**
+     * Finds the depth of node v (the root has depth 0).
+     */
+    int depth(int v) const;
+
+    /**
+     * Finds the number of edges on the path between nodes i and j, in O(1) time.
+     */
+    int distance(int i, int j) const;
+
+    /**
+     * Finds the ancestor of node v at depth d, in O(log n) time.
+     * @param v index of the node in nodeVals
+     * @param d depth of the ancestor, in [0, depth(v)]
+     * @return index of the ancestor in nodeVals (v itself if d == depth(v))
+     */
+    int levelAncestor(int v, int d) const;
+
+    /**
+     * Saves the preprocessed structure to a snapshot file (see Snapshot.hpp).
+     */
+    void save(const std::string &path) const;
+
+    /**
+     * Loads a structure saved by save(). The file is memory-mapped and queries read directly
+     * from the mapping, so loading does not depend on the size of the tree. Throws
+     * std::runtime_error if the header or the array lengths are inconsistent; corrupt array
+     * contents are only caught by the checksums.
+     * @param verifyChecksums also verify the checksum of every array (reads the whole file)
+     */
+    static LCA load(const std::string &path, bool verifyChecksums = false);
+
+protected:
+    void preprocessForLCA(const TreeView &tree, Traversals *traversals = nullptr, int threads = 0);
 
 private:
     // Euler Tour
-    std::vector<int> etSeq; // sequence of indices over nodeVals
-    std::vector<int> depthEtSeq;
-    std::vector<int> firstOccurrence;
-    std::vector<int> depth;
+    Array<int> etSeq; // sequence of indices over nodeVals
+    Array<int> depthEtSeq;
+    Array<int> firstOccurrence;
 
     // Block-level data
+    int blockBits;  // blocks of blockSize = 2^blockBits positions, so that positions split by shifts and masks
     int blockSize;
-    std::vector<int> prefixMinIndex;
-    std::vector<int> suffixMinIndex;
-    std::vector<int> blockMinIndex;
-    std::vector<std::vector<int>> pow2Windows;      // Sparse Table: pow2Windows[i] contains mins for windows of size 2^(i+1)
-    std::vector<int> blockBinaryString;             // maps from block index to the int-encoded block binary string
-    std::vector<std::vector<std::vector<int>>> MIN; // MIN[b][i][j]: index of min depth over the range i...j within block b
-
-    void eulerTour();
-    void dfs(int root, int d);
-    int minByDepth(int i, int j);
-    int blockRangeRMQ(int k, int l);
-    int singleBlockRMQ(int block, int i, int j);
+    Array<int> prefixMinIndex; // both left empty when the in-block minima are looked up in MIN instead
+    Array<int> suffixMinIndex;
+    std::vector<Array<int>> pow2Windows;       // Sparse Table: pow2Windows[e] contains min indices for windows of 2^e whole blocks
+    Array<uint16_t> blockBinaryString;         // maps from block index to the int-encoded block binary string
+    const uint8_t *MIN = nullptr;              // MIN[(s * blockSize + i) * blockSize + j]: offset of min depth over the range i...j
+                                               // within any block with binary string s (flat table over all 2^(blockSize-1) strings),
+                                               // shared by all the instances with the same blockSize (see BlockKernels.hpp)
+
+    void eulerTour(const TreeView &tree, Traversals *traversals);
+    void preprocessBlocks(int threads, int maxSpan = 0, bool inBlockArrays = true);
+    int minByDepth(int i, int j) const;
+    int prefixMin(int p) const;
+    int suffixMin(int p) const;
+    int lastWithinDepth(int pos, int d) const;
+    void checkIndex(int v) const;
+    int minPosition(int i, int j) const;
+    template <int BLOCK_BITS>
+    int minPositionFixed(int i, int j) const;
+    template <int BLOCK_BITS>
+    void rangeCandidates(int i, int j, int candidates[4]) const;
+    void lcaTile(const int *src, const int *dst, int *out, int n) const;
+    template <int BLOCK_BITS>
+    void lcaTileFixed(const int *src, const int *dst, int *out, int n) const;
+    void writeState(SnapshotWriter &writer) const;
+    void readState(SnapshotReader &reader);
 };
 
 #endif // LCA_HPP
\ No newline at end of file
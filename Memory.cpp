@@ -0,0 +1,221 @@
+#include "Memory.hpp"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/mempolicy.h>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <new>
+#include <cstdint>
+
+#define SMALL_PAGE_BYTES ((size_t)4 << 10)
+#define HUGE_PAGE_2MB_BYTES ((size_t)2 << 20)
+#define HUGE_PAGE_1GB_BYTES ((size_t)1 << 30)
+#define MAX_NUMA_NODES 1024
+
+class HeapMemory : public MemoryResource
+{
+public:
+    void *allocate(size_t bytes) override { return ::operator new(bytes); }
+    void deallocate(void *p, size_t bytes) override { ::operator delete(p); }
+};
+
+// nullptr stands for the heap, so that arrays created during static initialisation are safe
+static thread_local MemoryResource *currentArrayMemory = nullptr;
+
+MemoryResource *heapMemory()
+{
+    static HeapMemory heap;
+    return &heap;
+}
+
+MemoryResource *arrayMemory()
+{
+    return currentArrayMemory ? currentArrayMemory : heapMemory();
+}
+
+ScopedArrayMemory::ScopedArrayMemory(MemoryResource *resource) : previous(currentArrayMemory)
+{
+    currentArrayMemory = resource;
+}
+
+ScopedArrayMemory::~ScopedArrayMemory()
+{
+    currentArrayMemory = previous;
+}
+
+const char *pageSizeName(PageSize pages)
+{
+    const char *names[] = {"small", "transparent", "huge2MB", "huge1GB"};
+    return names[pages];
+}
+
+const char *numaPolicyName(NumaPolicy numa)
+{
+    const char *names[] = {"default", "interleave", "bind"};
+    return names[numa];
+}
+
+// the highest node listed in /sys/devices/system/node/online (e.g. "0-1,3"), plus one
+int numaNodeCount()
+{
+    static const int count = []()
+    {
+        std::ifstream online("/sys/devices/system/node/online");
+        std::string list;
+        if (!(online >> list))
+        {
+            return 1;
+        }
+        int highest = 0, value = 0;
+        for (char c : list + ",")
+        {
+            if (c >= '0' && c <= '9')
+            {
+                value = value * 10 + (c - '0');
+            }
+            else
+            {
+                highest = std::max(highest, value);
+                value = 0;
+            }
+        }
+        return std::min(highest + 1, MAX_NUMA_NODES);
+    }();
+    return count;
+}
+
+int currentNumaNode()
+{
+    unsigned cpu = 0, node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0)
+    {
+        return 0;
+    }
+    return node;
+}
+
+PageMemory::PageMemory(PageSize pages, NumaPolicy numa, int node) : pages(pages), numa(numa), node(node), fallbackCount(0)
+{
+}
+
+// the size of the mapping of an allocation, a whole number of pages: 1GB pages are only used by
+// the explicit huge page mappings, and their transparent fallbacks are made of 2MB ones
+size_t PageMemory::mappingSize(size_t bytes, bool gigantic) const
+{
+    size_t page = pages == PAGES_SMALL ? SMALL_PAGE_BYTES : gigantic ? HUGE_PAGE_1GB_BYTES : HUGE_PAGE_2MB_BYTES;
+    return (bytes + page - 1) / page * page;
+}
+
+void *PageMemory::allocate(size_t bytes)
+{
+    if (bytes < PAGE_MEMORY_MIN_BYTES)
+    {
+        return heapMemory()->allocate(bytes);
+    }
+
+    bool gigantic = pages == PAGES_HUGE_1GB;
+    size_t size = mappingSize(bytes, gigantic);
+    void *p = MAP_FAILED;
+    if (pages == PAGES_HUGE_2MB || pages == PAGES_HUGE_1GB)
+    {
+        int pageShift = gigantic ? 30 : 21;
+        p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (pageShift << MAP_HUGE_SHIFT), -1, 0);
+        if (p == MAP_FAILED) // no reserved huge pages: fall back to transparent ones, in 2MB multiples
+        {
+            fallbackCount++;
+            size = mappingSize(bytes, false);
+        }
+        else if (gigantic) // deallocate() must unmap it whole
+        {
+            std::lock_guard<std::mutex> lock(giganticLock);
+            giganticMappings.insert(p);
+        }
+    }
+    if (p == MAP_FAILED && pages != PAGES_SMALL)
+    {
+        p = mapTransparent(size);
+    }
+    else if (p == MAP_FAILED)
+    {
+        p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (p == MAP_FAILED)
+    {
+        throw std::bad_alloc();
+    }
+
+    // the policy applies to pages faulted in from now on, and none has been touched yet
+    bind(p, size);
+    return p;
+}
+
+void PageMemory::deallocate(void *p, size_t bytes)
+{
+    if (bytes < PAGE_MEMORY_MIN_BYTES)
+    {
+        heapMemory()->deallocate(p, bytes);
+        return;
+    }
+    bool gigantic = false;
+    if (pages == PAGES_HUGE_1GB)
+    {
+        std::lock_guard<std::mutex> lock(giganticLock);
+        gigantic = giganticMappings.erase(p) > 0;
+    }
+    munmap(p, mappingSize(bytes, gigantic));
+}
+
+// maps size bytes at a 2MB boundary, so that the kernel can back them with huge pages
+void *PageMemory::mapTransparent(size_t size)
+{
+    char *raw = (char *)mmap(nullptr, size + HUGE_PAGE_2MB_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED)
+    {
+        return MAP_FAILED;
+    }
+    char *aligned = (char *)(((uintptr_t)raw + HUGE_PAGE_2MB_BYTES - 1) / HUGE_PAGE_2MB_BYTES * HUGE_PAGE_2MB_BYTES);
+    if (aligned > raw)
+    {
+        munmap(raw, aligned - raw);
+    }
+    munmap(aligned + size, raw + HUGE_PAGE_2MB_BYTES - aligned);
+    if (madvise(aligned, size, MADV_HUGEPAGE) != 0)
+    {
+        fallbackCount++;
+    }
+    return aligned;
+}
+
+void PageMemory::bind(void *p, size_t size)
+{
+    if (numa == NUMA_DEFAULT)
+    {
+        return;
+    }
+
+    unsigned long mask[MAX_NUMA_NODES / (8 * sizeof(unsigned long))] = {};
+    const int bitsPerWord = 8 * sizeof(unsigned long);
+    if (numa == NUMA_INTERLEAVE)
+    {
+        for (int n = 0; n < numaNodeCount(); n++)
+        {
+            mask[n / bitsPerWord] |= 1UL << (n % bitsPerWord);
+        }
+    }
+    else
+    {
+        mask[node / bitsPerWord] |= 1UL << (node % bitsPerWord);
+    }
+    int mode = numa == NUMA_INTERLEAVE ? MPOL_INTERLEAVE : MPOL_BIND;
+    if (syscall(SYS_mbind, p, size, mode, mask, (unsigned long)MAX_NUMA_NODES, 0) != 0)
+    {
+        fallbackCount++;
+    }
+}
+
+size_t PageMemory::fallbacks() const
+{
+    return fallbackCount.load();
+}
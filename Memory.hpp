@@ -0,0 +1,199 @@
+#ifndef MEMORY_HPP
+#define MEMORY_HPP
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <type_traits>
+#include <cstddef>
+
+// Smallest allocation PageMemory maps on its own, below which the heap is used
+#define PAGE_MEMORY_MIN_BYTES (1 << 20)
+
+/*
+Memory of the arrays of the preprocessed structures (see Array.hpp). Every owned Array allocates
+from the resource that was current when it was created, the heap unless a ScopedArrayMemory
+selects another one, so the structures need no allocator parameters of their own.
+*/
+
+/**
+ * Source of memory for arrays. Implementations must be thread-safe.
+ */
+class MemoryResource
+{
+public:
+    virtual ~MemoryResource() {}
+    virtual void *allocate(size_t bytes) = 0;
+    virtual void deallocate(void *p, size_t bytes) = 0;
+};
+
+/**
+ * Returns the resource backed by operator new, the default one.
+ */
+MemoryResource *heapMemory();
+
+/**
+ * Returns the resource new arrays allocate from.
+ */
+MemoryResource *arrayMemory();
+
+/**
+ * Makes arrays created during its lifetime on the calling thread allocate from resource; the
+ * previous resource is restored on destruction. The setting is per thread, so structures meant
+ * for different resources can be built concurrently; the preprocessing threads started through
+ * Parallel.hpp take on the resource of the thread that starts them. The resource must outlive
+ * the arrays.
+ */
+class ScopedArrayMemory
+{
+public:
+    explicit ScopedArrayMemory(MemoryResource *resource);
+    ~ScopedArrayMemory();
+
+private:
+    MemoryResource *previous;
+
+    ScopedArrayMemory(const ScopedArrayMemory &) = delete;
+    ScopedArrayMemory &operator=(const ScopedArrayMemory &) = delete;
+};
+
+// Pages backing the allocations of a PageMemory
+enum PageSize
+{
+    PAGES_SMALL = 0,       // regular pages
+    PAGES_TRANSPARENT = 1, // 2MB-aligned mappings advised for transparent huge pages
+    PAGES_HUGE_2MB = 2,    // explicit 2MB huge pages (MAP_HUGETLB), which must have been reserved
+    PAGES_HUGE_1GB = 3     // explicit 1GB huge pages (MAP_HUGETLB), which must have been reserved
+};
+
+// NUMA placement of the allocations of a PageMemory
+enum NumaPolicy
+{
+    NUMA_DEFAULT = 0,    // the kernel's: first touch, usually the node of the preprocessing thread
+    NUMA_INTERLEAVE = 1, // pages spread round-robin over all the nodes
+    NUMA_BIND = 2        // pages on one given node
+};
+
+const char *pageSizeName(PageSize pages);
+const char *numaPolicyName(NumaPolicy numa);
+
+/**
+ * Returns the number of NUMA nodes (1 without NUMA support).
+ */
+int numaNodeCount();
+
+/**
+ * Returns the NUMA node of the CPU the calling thread runs on.
+ */
+int currentNumaNode();
+
+/**
+ * Resource that gives every large allocation its own anonymous mapping, with the requested
+ * pages and NUMA policy; allocations under PAGE_MEMORY_MIN_BYTES come from the heap.
+ * When explicit huge pages cannot be mapped (none reserved), the mapping falls back to
+ * transparent huge pages, rounded to 2MB rather than to the requested page size, and when the
+ * NUMA policy cannot be applied it is left to the kernel; fallbacks() counts both.
+ */
+class PageMemory : public MemoryResource
+{
+public:
+    PageMemory(PageSize pages, NumaPolicy numa = NUMA_DEFAULT, int node = 0);
+
+    void *allocate(size_t bytes) override;
+    void deallocate(void *p, size_t bytes) override;
+
+    /**
+     * Returns the number of allocations that did not get the requested pages or NUMA policy.
+     */
+    size_t fallbacks() const;
+
+private:
+    PageSize pages;
+    NumaPolicy numa;
+    int node;
+    std::atomic<size_t> fallbackCount;
+    std::mutex giganticLock;
+    std::set<void *> giganticMappings; // the allocations mapped with 1GB pages
+
+    size_t mappingSize(size_t bytes, bool gigantic) const;
+    void *mapTransparent(size_t size);
+    void bind(void *p, size_t size);
+};
+
+/**
+ * One copy of a structure per NUMA node, each with its arrays bound to its node, so that query
+ * threads read local memory: local() returns the copy of the caller's node. The copies are made
+ * with the structure's copy constructor; arrays borrowed from a snapshot mapping stay shared.
+ */
+template <typename S>
+class NumaReplicated
+{
+public:
+    explicit NumaReplicated(const S &structure, PageSize pages = PAGES_TRANSPARENT)
+    {
+        int nodes = numaNodeCount();
+        for (int node = 0; node < nodes; node++)
+        {
+            memory.emplace_back(new PageMemory(pages, NUMA_BIND, node));
+            ScopedArrayMemory scope(memory.back().get());
+            replicas.emplace_back(new S(structure));
+        }
+    }
+
+    const S &local() const
+    {
+        int node = currentNumaNode();
+        return *replicas[node < replicas.size() ? node : 0];
+    }
+
+    const S &replica(int node) const { return *replicas[node]; }
+
+    int replicaCount() const { return replicas.size(); }
+
+private:
+    // declared first, so that the replicas release their arrays before the memory goes away
+    std::vector<std::unique_ptr<PageMemory>> memory;
+    std::vector<std::unique_ptr<S>> replicas;
+};
+
+/**
+ * Standard allocator over a MemoryResource, by default the current arrayMemory(). Copies of a
+ * container allocate from the resource current at the time of the copy.
+ */
+template <typename T>
+struct ResourceAllocator
+{
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    MemoryResource *resource;
+
+    ResourceAllocator() : resource(arrayMemory()) {}
+
+    template <typename U>
+    ResourceAllocator(const ResourceAllocator<U> &other) : resource(other.resource) {}
+
+    T *allocate(size_t n) { return (T *)resource->allocate(n * sizeof(T)); }
+
+    void deallocate(T *p, size_t n) { resource->deallocate(p, n * sizeof(T)); }
+
+    ResourceAllocator select_on_container_copy_construction() const { return ResourceAllocator(); }
+};
+
+template <typename T, typename U>
+bool operator==(const ResourceAllocator<T> &a, const ResourceAllocator<U> &b)
+{
+    return a.resource == b.resource;
+}
+
+template <typename T, typename U>
+bool operator!=(const ResourceAllocator<T> &a, const ResourceAllocator<U> &b)
+{
+    return a.resource != b.resource;
+}
+
+#endif // MEMORY_HPP
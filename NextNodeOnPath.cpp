@@ -1,60 +1,429 @@
 #include "NextNodeOnPath.hpp"
+#include "Batch.hpp"
+#include "Parallel.hpp"
+#include "Snapshot.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <memory>
 
 NextNodeOnPath::NextNodeOnPath(const std::vector<int> &nodeVals,
                                const std::vector<int> &parent,
                                const std::vector<std::vector<int>> &children,
-                               int root) : nodeVals(nodeVals),
-                                           parent(parent),
-                                           children(children),
-                                           root(root)
+                               int root) : NextNodeOnPath(CSRTree(parent, children, root).view())
 {
-    nodeToPreOrderPosition.resize(nodeVals.size());
-    nodeToPostOrderPosition.resize(nodeVals.size());
-    preOrderLabelsInPostOrder.resize(nodeVals.size());
+}
+
+NextNodeOnPath::NextNodeOnPath(const TreeView &tree, int threads, NodeOrder order)
+    : NextNodeOnPath(tree, threads, 0, order)
+{
+}
+
+NextNodeOnPath::NextNodeOnPath(const TreeView &tree, int threads, int maxComponentSize, NodeOrder order) : order(order)
+{
+    if (order == NODE_ORDER_PRE_ORDER)
+    {
+        relabel(tree, threads, maxComponentSize);
+    }
+    else
+    {
+        preprocess(tree, threads, maxComponentSize);
+    }
+}
+
+void NextNodeOnPath::preprocess(const TreeView &tree, int threads, int maxComponentSize)
+{
+    parent = std::vector<int>(tree.parent, tree.parent + tree.size);
+
+    // Euler Tour of the tree; the same traversal yields the pre-order and post-order traversals
+    Traversals traversals;
+    treeLCA.eulerTour(tree, &traversals);
+
+    // the rest of the LCA preprocessing only depends on the Euler Tour, and the labels RMQ only
+    // on the traversals: build them concurrently, each with half of the threads
+    threads = resolveThreadCount(threads);
+    std::unique_ptr<JoiningThread> lcaBuilder; // joined on the way out if the labels throw
+    if (threads > 1)
+    {
+        int lcaThreads = (threads + 1) / 2;
+        lcaBuilder.reset(new JoiningThread([this, lcaThreads, maxComponentSize]()
+        {
+            treeLCA.preprocessBlocks(lcaThreads, 2 * maxComponentSize, true);
+        }));
+        threads /= 2;
+    }
+    else
+    {
+        treeLCA.preprocessBlocks(1, 2 * maxComponentSize);
+    }
 
     // compute pre-order labels
-    preOrder(root);
+    preOrderTraversal = std::move(traversals.preOrder);
+    std::vector<int> nodeToPreOrderPosition(tree.size);
+    parallelFor(tree.size, PREPROCESS_THREAD_GRAIN, threads, [&](size_t begin, size_t end)
+    {
+        for (int k = begin; k < end; k++)
+        {
+            nodeToPreOrderPosition[preOrderTraversal[k]] = k;
+        }
+    });
 
     // sort pre-order labels by post-order
-    sortLabelsByPostOrder(root);
+    const std::vector<int> &postOrderTraversal = traversals.postOrder;
+    nodeToPostOrderPosition.resize(tree.size);
+    std::vector<int> preOrderLabelsInPostOrder(tree.size);
+    parallelFor(tree.size, PREPROCESS_THREAD_GRAIN, threads, [&](size_t begin, size_t end)
+    {
+        for (int k = begin; k < end; k++)
+        {
+            nodeToPostOrderPosition[postOrderTraversal[k]] = k;
+            preOrderLabelsInPostOrder[k] = nodeToPreOrderPosition[postOrderTraversal[k]];
+        }
+    });
 
     // preprocess labels for range min queries
-    labelsRMQ = RMQ(preOrderLabelsInPostOrder);
+    labelsRMQ = RMQ<int>(preOrderLabelsInPostOrder, threads, std::less<int>(), maxComponentSize);
+
+    if (lcaBuilder)
+    {
+        lcaBuilder->join();
+    }
+}
+
+/*
+Renumbers the nodes in pre-order and preprocesses the renumbered tree. In pre-order, every subtree
+is a contiguous range of ids and the pre-order traversal is the identity, so the ancestor test of
+a query needs no LCA: i is an ancestor of j iff i <= j <= subtreeEnd(i). What a query reads for a
+node then fits one record, and answers are translated back through the id stored in it.
+*/
+void NextNodeOnPath::relabel(const TreeView &tree, int threads, int maxComponentSize)
+{
+    // pre-order of the caller's tree, visiting children in CSR order like the Euler Tour
+    std::vector<int> preOrder;
+    preOrder.reserve(tree.size);
+    std::vector<int> stack(1, tree.root);
+    while (!stack.empty())
+    {
+        int v = stack.back();
+        stack.pop_back();
+        preOrder.push_back(v);
+        for (int c = tree.childOffsets[v + 1] - 1; c >= tree.childOffsets[v]; c--)
+        {
+            stack.push_back(tree.childList[c]);
+        }
+    }
+
+    callerToInternal.resize(tree.size);
+    parallelFor(tree.size, PREPROCESS_THREAD_GRAIN, threads, [&](size_t begin, size_t end)
+    {
+        for (int k = begin; k < end; k++)
+        {
+            callerToInternal[preOrder[k]] = k;
+        }
+    });
+    std::vector<int> internalParent(tree.size);
+    parallelFor(tree.size, PREPROCESS_THREAD_GRAIN, threads, [&](size_t begin, size_t end)
+    {
+        for (int k = begin; k < end; k++)
+        {
+            int p = tree.parent[preOrder[k]];
+            internalParent[k] = p == -1 ? -1 : callerToInternal[p];
+        }
+    });
+
+    // children are ordered by index, i.e. in their original order: the renumbered tree's
+    // pre-order is the identity
+    preprocess(CSRTree(std::move(internalParent)).view(), threads, maxComponentSize);
+
+    // children come after their parent in pre-order, so one backward pass finds the subtree ends
+    std::vector<int> subtreeEnd(tree.size);
+    for (int k = tree.size - 1; k >= 0; k--)
+    {
+        subtreeEnd[k] = std::max(subtreeEnd[k], k);
+        if (parent[k] != -1)
+        {
+            subtreeEnd[parent[k]] = std::max(subtreeEnd[parent[k]], subtreeEnd[k]);
+        }
+    }
+
+    records.resize(tree.size);
+    parallelFor(tree.size, PREPROCESS_THREAD_GRAIN, threads, [&](size_t begin, size_t end)
+    {
+        for (int k = begin; k < end; k++)
+        {
+            records[k] = {subtreeEnd[k], nodeToPostOrderPosition[k], tree.parent[preOrder[k]], preOrder[k]};
+        }
+    });
+
+    // everything else a query needs is in the records
+    parent = Array<int>();
+    preOrderTraversal = Array<int>();
+    nodeToPostOrderPosition = Array<int>();
+}
+
+// Caller's id to internal id (checked when the nodes are renumbered)
+int NextNodeOnPath::internalId(int v) const
+{
+    if (order == NODE_ORDER_INPUT)
+    {
+        return v;
+    }
+    if (v < 0 || v >= callerToInternal.size())
+    {
+        throw std::out_of_range("Index out of bounds.");
+    }
+    return callerToInternal[v];
+}
+
+// Internal id to caller's id
+int NextNodeOnPath::callerId(int v) const
+{
+    return order == NODE_ORDER_INPUT ? v : records[v].id;
+}
 
-    // preprocess tree for LCA
-    treeLCA = LCA(nodeVals, parent, children, root);
+int NextNodeOnPath::size() const
+{
+    return order == NODE_ORDER_INPUT ? parent.size() : records.size();
 }
 
-int NextNodeOnPath::query(int i, int j)
+int NextNodeOnPath::query(int i, int j) const
 {
+    if (order == NODE_ORDER_PRE_ORDER)
+    {
+        return relabeledQuery(i, j);
+    }
+
     if (treeLCA.lca(i, j) != i) // j not in i's subtree: go up
     {
         return parent[i];
     }
+    if (i == j) // the path is i alone
+    {
+        return -1;
+    }
 
     // j is in i's subtree: descent into the correct child, found by RMQ on preOrderLabelsInPostOrder
     return preOrderTraversal[labelsRMQ.rangeMin(nodeToPostOrderPosition[j], nodeToPostOrderPosition[i] - 1)];
 }
 
-void NextNodeOnPath::preOrder(int root)
+int NextNodeOnPath::relabeledQuery(int i, int j) const
 {
-    nodeToPreOrderPosition[root] = preOrderTraversal.size();
-    preOrderTraversal.push_back(root);
+    i = internalId(i);
+    j = internalId(j);
+    if (i == j) // the path is i alone
+    {
+        return -1;
+    }
+    const NodeRecord &record = records[i];
+    if (j < i || j > record.subtreeEnd) // j not in i's subtree: go up
+    {
+        return record.parent;
+    }
+
+    // j is in i's subtree: the RMQ labels are the internal ids themselves
+    return records[labelsRMQ.rangeMin(records[j].postOrderPosition, record.postOrderPosition - 1)].id;
+}
+
+int NextNodeOnPath::kthNodeOnPath(int i, int j, int k) const
+{
+    i = internalId(i);
+    j = internalId(j);
+    int a = treeLCA.lca(i, j);
+    int iDepth = treeLCA.depth(i), jDepth = treeLCA.depth(j), aDepth = treeLCA.depth(a);
+    if (k < 0 || k > iDepth + jDepth - 2 * aDepth)
+    {
+        throw std::out_of_range("Path position out of bounds.");
+    }
+
+    if (k <= iDepth - aDepth) // on the way up from i to the LCA
+    {
+        return callerId(treeLCA.levelAncestor(i, iDepth - k));
+    }
+    // on the way down from the LCA to j
+    return callerId(treeLCA.levelAncestor(j, aDepth + k - (iDepth - aDepth)));
+}
+
+int NextNodeOnPath::distance(int i, int j) const
+{
+    return treeLCA.distance(internalId(i), internalId(j));
+}
+
+int NextNodeOnPath::levelAncestor(int v, int d) const
+{
+    return callerId(treeLCA.levelAncestor(internalId(v), d));
+}
+
+void NextNodeOnPath::queryBatch(const int *src, const int *dst, int *out, size_t n, int threads) const
+{
+    validateBatchIndices(src, dst, n, size());
+
+    parallelFor(n, BATCH_THREAD_GRAIN, threads, [=](size_t begin, size_t end)
+    {
+        for (size_t q = begin; q < end; q += BATCH_TILE_SIZE)
+        {
+            int tileSize = std::min<size_t>(BATCH_TILE_SIZE, end - q);
+            if (order == NODE_ORDER_PRE_ORDER)
+            {
+                relabeledQueryTile(src + q, dst + q, out + q, tileSize);
+            }
+            else
+            {
+                queryTile(src + q, dst + q, out + q, tileSize);
+            }
+        }
+    });
+}
+
+/*
+Answers up to BATCH_TILE_SIZE unchecked queries: the LCAs of the whole tile are found first,
+then the queries that descend into i's subtree are gathered into one tile of range min queries.
+*/
+void NextNodeOnPath::queryTile(const int *src, const int *dst, int *out, int n) const
+{
+    int lcas[BATCH_TILE_SIZE];
+    treeLCA.lcaTile(src, dst, lcas, n);
+
+    // prefetch the parent for upward steps, the post-order positions for downward ones
+    for (int q = 0; q < n; q++)
+    {
+        if (lcas[q] != src[q])
+        {
+            prefetch(&parent[src[q]]);
+        }
+        else
+        {
+            prefetch(&nodeToPostOrderPosition[src[q]]);
+            prefetch(&nodeToPostOrderPosition[dst[q]]);
+        }
+    }
+
+    int down[BATCH_TILE_SIZE], rangeStart[BATCH_TILE_SIZE], rangeEnd[BATCH_TILE_SIZE];
+    int downCount = 0;
+    for (int q = 0; q < n; q++)
+    {
+        if (src[q] == dst[q])
+        {
+            out[q] = -1;
+        }
+        else if (lcas[q] != src[q]) // j not in i's subtree: go up
+        {
+            out[q] = parent[src[q]];
+        }
+        else
+        {
+            down[downCount] = q;
+            rangeStart[downCount] = nodeToPostOrderPosition[dst[q]];
+            rangeEnd[downCount] = nodeToPostOrderPosition[src[q]] - 1;
+            downCount++;
+        }
+    }
+
+    // j is in i's subtree: descent into the correct child, found by RMQ on preOrderLabelsInPostOrder
+    int labels[BATCH_TILE_SIZE];
+    labelsRMQ.rangeMinTile(rangeStart, rangeEnd, labels, downCount);
+    for (int d = 0; d < downCount; d++)
+    {
+        prefetch(&preOrderTraversal[labels[d]]);
+    }
+    for (int d = 0; d < downCount; d++)
+    {
+        out[down[d]] = preOrderTraversal[labels[d]];
+    }
+}
+
+/*
+Same as queryTile, for renumbered nodes: the internal ids of the tile are loaded first, then the
+records, and finally the records of the children found by the range min queries.
+*/
+void NextNodeOnPath::relabeledQueryTile(const int *src, const int *dst, int *out, int n) const
+{
+    for (int q = 0; q < n; q++)
+    {
+        prefetch(&callerToInternal[src[q]]);
+        prefetch(&callerToInternal[dst[q]]);
+    }
+    int from[BATCH_TILE_SIZE], to[BATCH_TILE_SIZE];
+    for (int q = 0; q < n; q++)
+    {
+        from[q] = callerToInternal[src[q]];
+        to[q] = callerToInternal[dst[q]];
+        prefetch(&records[from[q]]);
+        prefetch(&records[to[q]]);
+    }
+
+    int down[BATCH_TILE_SIZE], rangeStart[BATCH_TILE_SIZE], rangeEnd[BATCH_TILE_SIZE];
+    int downCount = 0;
+    for (int q = 0; q < n; q++)
+    {
+        const NodeRecord &record = records[from[q]];
+        if (from[q] == to[q])
+        {
+            out[q] = -1;
+        }
+        else if (to[q] < from[q] || to[q] > record.subtreeEnd) // j not in i's subtree: go up
+        {
+            out[q] = record.parent;
+        }
+        else
+        {
+            down[downCount] = q;
+            rangeStart[downCount] = records[to[q]].postOrderPosition;
+            rangeEnd[downCount] = record.postOrderPosition - 1;
+            downCount++;
+        }
+    }
 
-    for (int node : children[root]) // left to right
+    int labels[BATCH_TILE_SIZE];
+    labelsRMQ.rangeMinTile(rangeStart, rangeEnd, labels, downCount);
+    for (int d = 0; d < downCount; d++)
     {
-        preOrder(node);
+        prefetch(&records[labels[d]]);
+    }
+    for (int d = 0; d < downCount; d++)
+    {
+        out[down[d]] = records[labels[d]].id;
     }
 }
 
-void NextNodeOnPath::sortLabelsByPostOrder(int root)
+void NextNodeOnPath::save(const std::string &path) const
 {
-    for (int node : children[root]) // left to right
+    SnapshotWriter writer(SNAPSHOT_NEXT_NODE_ON_PATH);
+    writer.writeValue<uint32_t>(order);
+    writer.write(parent);
+    writer.write(preOrderTraversal);
+    writer.write(nodeToPostOrderPosition);
+    writer.write(callerToInternal);
+    writer.write(records);
+    treeLCA.writeState(writer);
+    labelsRMQ.writeState(writer);
+    writer.save(path);
+}
+
+NextNodeOnPath NextNodeOnPath::load(const std::string &path, bool verifyChecksums)
+{
+    SnapshotReader reader(path, SNAPSHOT_NEXT_NODE_ON_PATH, verifyChecksums);
+    NextNodeOnPath nextNodeOnPath;
+    uint32_t order = reader.readValue<uint32_t>();
+    if (order != NODE_ORDER_INPUT && order != NODE_ORDER_PRE_ORDER)
     {
-        sortLabelsByPostOrder(node);
+        throw std::runtime_error("Snapshot has an invalid node order.");
     }
+    nextNodeOnPath.order = (NodeOrder)order;
+    reader.read(nextNodeOnPath.parent);
+    reader.read(nextNodeOnPath.preOrderTraversal);
+    reader.read(nextNodeOnPath.nodeToPostOrderPosition);
+    reader.read(nextNodeOnPath.callerToInternal);
+    reader.read(nextNodeOnPath.records);
+    nextNodeOnPath.treeLCA.readState(reader);
+    nextNodeOnPath.labelsRMQ.readState(reader);
 
-    nodeToPostOrderPosition[root] = postOrderTraversal.size();
-    preOrderLabelsInPostOrder[postOrderTraversal.size()] = nodeToPreOrderPosition[root];
-    postOrderTraversal.push_back(root);
+    // each node order keeps its own per-node arrays, all over the nodes of the LCA
+    size_t n = nextNodeOnPath.treeLCA.firstOccurrence.size();
+    size_t inputArrays = order == NODE_ORDER_INPUT ? n : 0, preOrderArrays = n - inputArrays;
+    if (nextNodeOnPath.parent.size() != inputArrays || nextNodeOnPath.preOrderTraversal.size() != inputArrays ||
+        nextNodeOnPath.nodeToPostOrderPosition.size() != inputArrays || nextNodeOnPath.callerToInternal.size() != preOrderArrays ||
+        nextNodeOnPath.records.size() != preOrderArrays || nextNodeOnPath.labelsRMQ.seq.size() != n)
+    {
+        throw std::runtime_error("Snapshot has inconsistent NextNodeOnPath array lengths.");
+    }
+    return nextNodeOnPath;
 }
@@ -2,9 +2,26 @@
 #define NEXTNODEONPATH_HPP
 
 #include <vector>
+#include <cstddef>
+#include <string>
 #include "RMQ.hpp"
 #include "LCA.hpp"
+#include "CSRTree.hpp"
+#include "Array.hpp"
 
+// Internal numbering of the nodes of a NextNodeOnPath
+enum NodeOrder
+{
+    NODE_ORDER_INPUT = 0,    // the caller's ids
+    NODE_ORDER_PRE_ORDER = 1 // pre-order positions, with the per-node fields packed into one record
+};
+
+/**
+ * Class to find the next node on the unique path between two nodes of a tree in O(1) time,
+ * after O(n) space and time preprocessing.
+ * Once constructed (or loaded), the structure is read-only: query and queryBatch are const
+ * and thread-safe, so all query threads can share one instance.
+ */
 class NextNodeOnPath
 {
 public:
@@ -17,34 +34,111 @@ public:
                    const std::vector<std::vector<int>> &children,
                    int root);
 
+    /**
+     * Constructor. It reads the tree through a CSR view, without copying it;
+     * only the parent links are retained after preprocessing.
+     * With NODE_ORDER_PRE_ORDER the nodes are renumbered internally in pre-order, so that
+     * subtrees and Euler Tour neighbours are contiguous in memory whatever the caller's ids,
+     * and the fields a query reads for a node share one 16-byte record. Queries still take
+     * and return the caller's ids.
+     * @param threads maximum number of preprocessing threads (0 means one per hardware thread)
+     * @param order internal numbering of the nodes
+     */
+    NextNodeOnPath(const TreeView &tree, int threads = 0, NodeOrder order = NODE_ORDER_INPUT);
+
     /**
      * Finds the next node on the unique path between nodes i and j.
      * @param i index of first node in nodeVals
      * @param j index of second node in nodeVals
-     * @return next-node-on-path(i, j) (index in nodeVals)
+     * @return next-node-on-path(i, j) (index in nodeVals), or -1 when i == j
+     */
+    int query(int i, int j) const;
+
+    /**
+     * Answers a batch of next-node-on-path queries: out[q] = next-node-on-path(src[q], dst[q]),
+     * or -1 when src[q] == dst[q].
+     * Indices are validated once for the whole batch; queries are then answered
+     * without further checks, in tiles that overlap their memory accesses,
+     * and split across threads for large batches.
+     * @param threads maximum number of threads (0 means one per hardware thread)
+     */
+    void queryBatch(const int *src, const int *dst, int *out, size_t n, int threads = 0) const;
+
+    /**
+     * Finds the k-th node on the unique path from node i to node j, in O(log n) time.
+     * @param k number of steps from i, in [0, distance(i, j)]: kthNodeOnPath(i, j, 1) == query(i, j)
+     * @return index of the node in nodeVals
+     */
+    int kthNodeOnPath(int i, int j, int k) const;
+
+    /**
+     * Finds the number of edges on the path between nodes i and j, in O(1) time.
+     */
+    int distance(int i, int j) const;
+
+    /**
+     * Finds the ancestor of node v at depth d (the root has depth 0), in O(log n) time.
      */
-    int query(int i, int j);
+    int levelAncestor(int v, int d) const;
+
+    /**
+     * Saves the preprocessed structure, including its LCA and RMQ, to a snapshot file
+     * (see Snapshot.hpp).
+     */
+    void save(const std::string &path) const;
+
+    /**
+     * Loads a structure saved by save(). The file is memory-mapped and queries read directly
+     * from the mapping, so loading does not depend on the size of the tree. Throws
+     * std::runtime_error if the header or the array lengths are inconsistent; corrupt array
+     * contents are only caught by the checksums.
+     * @param verifyChecksums also verify the checksum of every array (reads the whole file)
+     */
+    static NextNodeOnPath load(const std::string &path, bool verifyChecksums = false);
 
 private:
-    // Tree representation
-    std::vector<int> nodeVals;
-    std::vector<int> parent;
-    std::vector<std::vector<int>> children;
-    int root;
-
-    // Traversals data
-    std::vector<int> preOrderTraversal;
-    std::vector<int> postOrderTraversal;
-    std::vector<int> nodeToPreOrderPosition;
-    std::vector<int> nodeToPostOrderPosition;
-    std::vector<int> preOrderLabelsInPostOrder;
-
-    // RMQ and LCA objects
-    RMQ labelsRMQ;
-    LCA treeLCA;
+    friend class Forest;
+
+    NextNodeOnPath() {}
 
-    void preOrder(int root);
-    void sortLabelsByPostOrder(int root);
+    // Fields of the node with pre-order position k, when the nodes are renumbered in pre-order
+    struct alignas(16) NodeRecord
+    {
+        int subtreeEnd;        // last pre-order position in the node's subtree
+        int postOrderPosition;
+        int parent;            // caller's id of the parent (-1 for the root)
+        int id;                // caller's id of the node
+    };
+
+    // Preprocesses a tree whose queries all fall within subtrees of the root with at most
+    // maxComponentSize nodes (0 means no limit), which bounds the RMQ and LCA ranges
+    NextNodeOnPath(const TreeView &tree, int threads, int maxComponentSize, NodeOrder order = NODE_ORDER_INPUT);
+
+    void preprocess(const TreeView &tree, int threads, int maxComponentSize);
+    void relabel(const TreeView &tree, int threads, int maxComponentSize);
+    int internalId(int v) const;
+    int callerId(int v) const;
+    int size() const;
+    int relabeledQuery(int i, int j) const;
+    void queryTile(const int *src, const int *dst, int *out, int n) const;
+    void relabeledQueryTile(const int *src, const int *dst, int *out, int n) const;
+
+    NodeOrder order = NODE_ORDER_INPUT;
+
+    // Tree representation (NODE_ORDER_INPUT only)
+    Array<int> parent;
+
+    // Traversals data (NODE_ORDER_INPUT only)
+    Array<int> preOrderTraversal;
+    Array<int> nodeToPostOrderPosition;
+
+    // Caller's id to pre-order position, and records by pre-order position (NODE_ORDER_PRE_ORDER only)
+    Array<int> callerToInternal;
+    Array<NodeRecord> records;
+
+    // RMQ and LCA objects, over internal ids
+    RMQ<int> labelsRMQ;
+    LCA treeLCA;
 };
 
 #endif // NEXTNODEONPATH_HPP
\ No newline at end of file
@@ -0,0 +1,190 @@
+#include "OfflineQueries.hpp"
+#include "Batch.hpp"
+#include "Parallel.hpp"
+#include <vector>
+#include <algorithm>
+#include <climits>
+
+// Distance, in queries, at which the random accesses of the sort and of the sweep are prefetched
+#define OFFLINE_PREFETCH_DISTANCE 16
+
+// Pre-order of the tree, shared read-only by all the chunks
+struct OfflineTree
+{
+    const TreeView &tree;
+    std::vector<int> order;    // nodes in pre-order
+    std::vector<int> position; // pre-order position of each node
+    std::vector<int> depth;
+
+    explicit OfflineTree(const TreeView &tree);
+};
+
+// A query, filed under the pre-order position of its later endpoint
+struct OfflineEntry
+{
+    int earlier; // the other endpoint, entered first (or the same node)
+    int source;  // src of the query
+    int query;   // index of the query in the batch
+};
+
+// Buffers of one thread, reused from chunk to chunk
+struct OfflineBuffers
+{
+    std::vector<int> bucketEnd;
+    std::vector<OfflineEntry> entries;
+    std::vector<int> link; // parent of each finished node, -1 for the others
+    std::vector<int> path; // nodes from the root to the current one
+};
+
+OfflineTree::OfflineTree(const TreeView &tree) : tree(tree), position(tree.size), depth(tree.size)
+{
+    order.reserve(tree.size);
+    std::vector<int> stack(1, tree.root);
+    while (!stack.empty())
+    {
+        int v = stack.back();
+        stack.pop_back();
+        position[v] = order.size();
+        depth[v] = tree.parent[v] == -1 ? 0 : depth[tree.parent[v]] + 1;
+        order.push_back(v);
+        for (int c = tree.childOffsets[v + 1]; c-- > tree.childOffsets[v];)
+        {
+            stack.push_back(tree.childList[c]);
+        }
+    }
+}
+
+/*
+Follows the links of the finished nodes from v up to a node still on the path, the LCA of v with
+the current node, halving the links on the way.
+*/
+static int findOnPath(std::vector<int> &link, int v)
+{
+    while (link[v] != -1)
+    {
+        int up = link[v];
+        if (link[up] != -1)
+        {
+            link[v] = link[up];
+        }
+        v = up;
+    }
+    return v;
+}
+
+/*
+Answers the queries src[0...n - 1], dst[0...n - 1] with one sweep of the tree: nodes are entered
+in pre-order, and those left by the path on the way are linked to their parents.
+*/
+static void answerChunk(const OfflineTree &offline, const int *src, const int *dst, int *out, size_t n,
+                        bool nextNode, OfflineBuffers &buffers)
+{
+    const TreeView &tree = offline.tree;
+    const std::vector<int> &position = offline.position;
+
+    // counting sort by the position of the later endpoint: bucketEnd[p] ends up as the end of
+    // bucket p, i.e. the start of bucket p + 1
+    std::vector<int> &bucketEnd = buffers.bucketEnd;
+    bucketEnd.assign(tree.size + 1, 0);
+    for (size_t q = 0; q < n; q++)
+    {
+        if (q + OFFLINE_PREFETCH_DISTANCE < n)
+        {
+            prefetch(&position[src[q + OFFLINE_PREFETCH_DISTANCE]]);
+            prefetch(&position[dst[q + OFFLINE_PREFETCH_DISTANCE]]);
+        }
+        bucketEnd[std::max(position[src[q]], position[dst[q]]) + 1]++;
+    }
+    for (int p = 0; p < tree.size; p++)
+    {
+        bucketEnd[p + 1] += bucketEnd[p];
+    }
+    std::vector<OfflineEntry> &entries = buffers.entries;
+    entries.resize(n);
+    for (size_t q = 0; q < n; q++)
+    {
+        if (q + OFFLINE_PREFETCH_DISTANCE < n)
+        {
+            int i = src[q + OFFLINE_PREFETCH_DISTANCE], j = dst[q + OFFLINE_PREFETCH_DISTANCE];
+            prefetch(&position[i]);
+            prefetch(&position[j]);
+        }
+        int i = src[q], j = dst[q];
+        bool srcLater = position[i] > position[j];
+        OfflineEntry &entry = entries[bucketEnd[position[srcLater ? i : j]]++];
+        entry.earlier = srcLater ? j : i;
+        entry.source = i;
+        entry.query = q;
+    }
+
+    std::vector<int> &link = buffers.link, &path = buffers.path;
+    link.assign(tree.size, -1);
+    path.clear();
+    size_t e = 0;
+    for (int p = 0; p < tree.size; p++)
+    {
+        int u = offline.order[p];
+        while (!path.empty() && path.back() != tree.parent[u])
+        {
+            link[path.back()] = tree.parent[path.back()];
+            path.pop_back();
+        }
+        path.push_back(u);
+
+        for (; e < bucketEnd[p]; e++)
+        {
+            if (e + OFFLINE_PREFETCH_DISTANCE < n)
+            {
+                const OfflineEntry &ahead = entries[e + OFFLINE_PREFETCH_DISTANCE];
+                prefetch(&link[ahead.earlier]);
+                prefetch(&out[ahead.query]);
+            }
+            const OfflineEntry &entry = entries[e];
+            int lca = findOnPath(link, entry.earlier);
+            if (!nextNode)
+            {
+                out[entry.query] = lca;
+            }
+            else if (lca != entry.source) // the destination is not in the source's subtree: go up
+            {
+                out[entry.query] = tree.parent[entry.source];
+            }
+            else // the source is on the path above u, the destination, unless they are the same node
+            {
+                out[entry.query] = entry.source == u ? -1 : path[offline.depth[entry.source] + 1];
+            }
+        }
+    }
+}
+
+static void answerOffline(const TreeView &tree, const int *src, const int *dst, int *out, size_t n,
+                          int threads, bool nextNode)
+{
+    validateBatchIndices(src, dst, n, tree.size);
+    const OfflineTree offline(tree);
+
+    // each chunk sweeps the whole tree, so a chunk, and a thread, needs a few queries per node to
+    // pay off; the bucket offsets of a chunk are ints
+    size_t chunkSize = std::max<size_t>(OFFLINE_CHUNK_SIZE, OFFLINE_CHUNK_QUERIES_PER_NODE * (size_t)tree.size);
+    chunkSize = std::min<size_t>(chunkSize, INT_MAX);
+    size_t grain = std::max<size_t>(BATCH_THREAD_GRAIN, OFFLINE_CHUNK_QUERIES_PER_NODE * (size_t)tree.size);
+    parallelFor(n, grain, threads, [&](size_t begin, size_t end)
+    {
+        OfflineBuffers buffers;
+        for (size_t q = begin; q < end; q += chunkSize)
+        {
+            size_t count = std::min<size_t>(chunkSize, end - q);
+            answerChunk(offline, src + q, dst + q, out + q, count, nextNode, buffers);
+        }
+    });
+}
+
+void offlineLCA(const TreeView &tree, const int *src, const int *dst, int *out, size_t n, int threads)
+{
+    answerOffline(tree, src, dst, out, n, threads, false);
+}
+
+void offlineNextNodeOnPath(const TreeView &tree, const int *src, const int *dst, int *out, size_t n, int threads)
+{
+    answerOffline(tree, src, dst, out, n, threads, true);
+}
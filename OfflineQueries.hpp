@@ -0,0 +1,38 @@
+#ifndef OFFLINEQUERIES_HPP
+#define OFFLINEQUERIES_HPP
+
+#include <cstddef>
+#include "CSRTree.hpp"
+
+// Fewest queries sorted and answered per sweep of the tree, on small trees
+#define OFFLINE_CHUNK_SIZE (1 << 22)
+// Queries per node in a chunk on large trees, so that the O(n) sweep is spread over many queries
+#define OFFLINE_CHUNK_QUERIES_PER_NODE 2
+
+/*
+Offline LCA and next-node-on-path queries, for query sets known up front against a tree that is
+only used once: no O(1)-query structure is built. The queries are answered by Tarjan's offline
+algorithm, in near-linear time. Each chunk of queries is counting-sorted by the pre-order position
+of its later endpoint, and then answered during one sweep of the tree in pre-order, which reads
+the sorted queries sequentially: the earlier endpoint of a query, followed up through the finished
+subtrees with union-find, leads to the deepest ancestor still on the current root path, the LCA.
+A chunk holds at least OFFLINE_CHUNK_QUERIES_PER_NODE queries per node, so that the sweeps cost
+O(n) per that many queries; its buffers take about 12 bytes per query and 8 per node. Chunks are
+independent, so they are split across threads.
+*/
+
+/**
+ * Finds the LCAs of a batch of node pairs: out[q] = LCA(src[q], dst[q]).
+ * Indices are validated once for the whole batch.
+ * @param threads maximum number of threads (0 means one per hardware thread)
+ */
+void offlineLCA(const TreeView &tree, const int *src, const int *dst, int *out, size_t n, int threads = 0);
+
+/**
+ * Answers a batch of next-node-on-path queries: out[q] = next-node-on-path(src[q], dst[q]),
+ * or -1 when src[q] == dst[q]. Indices are validated once for the whole batch.
+ * @param threads maximum number of threads (0 means one per hardware thread)
+ */
+void offlineNextNodeOnPath(const TreeView &tree, const int *src, const int *dst, int *out, size_t n, int threads = 0);
+
+#endif // OFFLINEQUERIES_HPP
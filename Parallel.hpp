@@ -0,0 +1,107 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <cstddef>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <exception>
+#include "Memory.hpp"
+
+// Minimum number of array elements per thread in parallel preprocessing loops
+#define PREPROCESS_THREAD_GRAIN (1 << 16)
+
+/**
+ * Returns the number of threads to use when the caller asks for `threads`
+ * (0 means one per hardware thread).
+ */
+inline int resolveThreadCount(int threads)
+{
+    if (threads > 0)
+        return threads;
+    int hardwareThreads = std::thread::hardware_concurrency();
+    return hardwareThreads > 0 ? hardwareThreads : 1;
+}
+
+/**
+ * Thread running f that is joined when destroyed, so that an exception thrown on the creating
+ * thread while it runs unwinds instead of destroying a joinable std::thread (std::terminate).
+ * An exception thrown by f is kept, and rethrown by join(). f allocates its arrays from the
+ * arrayMemory() of the creating thread.
+ */
+class JoiningThread
+{
+public:
+    explicit JoiningThread(std::function<void()> f) : thread([this, f](MemoryResource *memory)
+    {
+        ScopedArrayMemory scope(memory);
+        try
+        {
+            f();
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+    }, arrayMemory())
+    {
+    }
+
+    ~JoiningThread()
+    {
+        if (thread.joinable())
+            thread.join();
+    }
+
+    /**
+     * Waits for f to return, and rethrows the exception it threw, if any.
+     */
+    void join()
+    {
+        thread.join();
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+private:
+    std::exception_ptr error; // set by the thread before it ends, read after joining it
+    std::thread thread;
+
+    JoiningThread(const JoiningThread &) = delete;
+    JoiningThread &operator=(const JoiningThread &) = delete;
+};
+
+/**
+ * Runs f(begin, end) over contiguous chunks of the range [0, n), one chunk per thread.
+ * Chunks hold at least `grain` items, so small ranges run entirely on the calling thread.
+ * @param threads maximum number of threads (0 means one per hardware thread)
+ */
+template <typename F>
+void parallelFor(size_t n, size_t grain, int threads, F f)
+{
+    size_t chunks = resolveThreadCount(threads);
+    if (grain > 0 && n / grain < chunks)
+        chunks = n / grain;
+    if (chunks <= 1)
+    {
+        f((size_t)0, n);
+        return;
+    }
+
+    // the calling thread takes the first chunk; the workers are joined even if a chunk throws,
+    // and the first exception is passed on
+    std::deque<JoiningThread> workers;
+    for (size_t c = 1; c < chunks; c++)
+    {
+        size_t begin = n * c / chunks, end = n * (c + 1) / chunks;
+        workers.emplace_back([&f, begin, end]() { f(begin, end); });
+    }
+    f((size_t)0, n / chunks);
+    for (JoiningThread &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+#endif // PARALLEL_HPP
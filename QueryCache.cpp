@@ -0,0 +1,152 @@
+#include "QueryCache.hpp"
+#include <new>
+
+// Key of the empty entries: (-1, -1), which is never cached since queries reject it
+#define QUERY_CACHE_EMPTY_KEY (~(uint64_t)0)
+
+QueryCache::QueryCache(size_t entries, bool countQueries)
+{
+    static_assert(sizeof(Set) == QUERY_CACHE_LINE_BYTES, "A set of a QueryCache must fill a cache line.");
+    static_assert(sizeof(Counters) == QUERY_CACHE_LINE_BYTES, "Counters of a QueryCache must fill a cache line.");
+
+    size_t setCount = 1;
+    while (setCount * QUERY_CACHE_WAYS < entries)
+    {
+        setCount *= 2;
+    }
+    setMask = setCount - 1;
+
+    // one line more than the sets and counters, so that they can start at a line boundary
+    size_t stripes = countQueries ? QUERY_CACHE_COUNTER_STRIPES : 0;
+    storage.reset(new char[(setCount + stripes + 1) * QUERY_CACHE_LINE_BYTES]);
+    uintptr_t first = ((uintptr_t)storage.get() + QUERY_CACHE_LINE_BYTES - 1) & ~(uintptr_t)(QUERY_CACHE_LINE_BYTES - 1);
+    sets = reinterpret_cast<Set *>(first);
+    for (size_t s = 0; s < setCount; s++)
+    {
+        new (&sets[s]) Set();
+    }
+    counters = countQueries ? reinterpret_cast<Counters *>(sets + setCount) : nullptr;
+    for (size_t c = 0; c < stripes; c++)
+    {
+        new (&counters[c]) Counters();
+    }
+    clear();
+}
+
+/*
+The set of a key is taken from a multiplicative hash folded onto its low bits, so that pairs that
+differ in i or j alone spread over the sets.
+*/
+QueryCache::Set &QueryCache::setOf(uint64_t key) const
+{
+    uint64_t hash = key * 0x9E3779B97F4A7C15ull;
+    size_t s = (hash ^ (hash >> 32)) & setMask;
+    return sets[s];
+}
+
+/*
+Each thread counts in one stripe of the counters, picked in turn the first time it counts, so that
+threads only share a line when there are more of them than stripes.
+*/
+QueryCache::Counters &QueryCache::countersOf(Counters *stripes)
+{
+    static std::atomic<unsigned> nextStripe(0);
+    static thread_local unsigned stripe = nextStripe++ % QUERY_CACHE_COUNTER_STRIPES;
+    return stripes[stripe];
+}
+
+/*
+The entries of a set are read between two reads of its version: if it changed, or was odd, an
+insert may have torn the entry, so the lookup is a miss. Nothing is written to the set, so that
+concurrent hits on the same pairs keep its line shared between the cores.
+*/
+bool QueryCache::lookup(int i, int j, int &result)
+{
+    uint64_t key = (uint64_t)(uint32_t)i << 32 | (uint32_t)j;
+    Set &set = setOf(key);
+    uint32_t version = set.version.load(std::memory_order_acquire);
+    bool found = false;
+    for (int w = 0; w < QUERY_CACHE_WAYS; w++)
+    {
+        if (set.keys[w].load(std::memory_order_relaxed) == key)
+        {
+            result = set.results[w].load(std::memory_order_relaxed);
+            found = true;
+        }
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    found = found && key != QUERY_CACHE_EMPTY_KEY && !(version & 1) &&
+            set.version.load(std::memory_order_relaxed) == version;
+
+    if (counters)
+    {
+        Counters &stripe = countersOf(counters);
+        (found ? stripe.hits : stripe.misses).fetch_add(1, std::memory_order_relaxed);
+    }
+    return found;
+}
+
+void QueryCache::insert(int i, int j, int result)
+{
+    uint64_t key = (uint64_t)(uint32_t)i << 32 | (uint32_t)j;
+    Set &set = setOf(key);
+
+    // take the set by making its version odd, unless another insert holds it
+    uint32_t version = set.version.load(std::memory_order_relaxed);
+    if ((version & 1) || !set.version.compare_exchange_strong(version, version + 1, std::memory_order_acquire))
+    {
+        return;
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+
+    // each insert into the set advances its version by 2, so the version also counts the
+    // inserts, and points to the oldest entry
+    int way = (version >> 1) % QUERY_CACHE_WAYS;
+    set.keys[way].store(key, std::memory_order_relaxed);
+    set.results[way].store(result, std::memory_order_relaxed);
+    set.version.store(version + 2, std::memory_order_release);
+}
+
+void QueryCache::clear()
+{
+    for (size_t s = 0; s <= setMask; s++)
+    {
+        Set &set = sets[s];
+        for (int w = 0; w < QUERY_CACHE_WAYS; w++)
+        {
+            set.keys[w].store(QUERY_CACHE_EMPTY_KEY, std::memory_order_relaxed);
+            set.results[w].store(0, std::memory_order_relaxed);
+        }
+        set.version.store(0, std::memory_order_relaxed);
+    }
+    for (size_t c = 0; counters && c < QUERY_CACHE_COUNTER_STRIPES; c++)
+    {
+        counters[c].hits.store(0, std::memory_order_relaxed);
+        counters[c].misses.store(0, std::memory_order_relaxed);
+    }
+}
+
+size_t QueryCache::capacity() const
+{
+    return (setMask + 1) * QUERY_CACHE_WAYS;
+}
+
+uint64_t QueryCache::hits() const
+{
+    uint64_t total = 0;
+    for (size_t c = 0; counters && c < QUERY_CACHE_COUNTER_STRIPES; c++)
+    {
+        total += counters[c].hits.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+uint64_t QueryCache::misses() const
+{
+    uint64_t total = 0;
+    for (size_t c = 0; counters && c < QUERY_CACHE_COUNTER_STRIPES; c++)
+    {
+        total += counters[c].misses.load(std::memory_order_relaxed);
+    }
+    return total;
+}
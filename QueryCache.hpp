@@ -0,0 +1,141 @@
+#ifndef QUERYCACHE_HPP
+#define QUERYCACHE_HPP
+
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include "NextNodeOnPath.hpp"
+#include "LCA.hpp"
+
+// Entries per set of a QueryCache: 4 keys, 4 results and the version of the set fit in a cache line
+#define QUERY_CACHE_WAYS 4
+
+// Size of a cache line, to which the sets of a QueryCache are aligned
+#define QUERY_CACHE_LINE_BYTES 64
+
+// Entries of a QueryCache, when not given
+#define QUERY_CACHE_DEFAULT_ENTRIES (1 << 16)
+
+// Cache lines of hit and miss counters of a QueryCache that counts its queries, shared out among threads
+#define QUERY_CACHE_COUNTER_STRIPES 16
+
+/**
+ * Fixed-size, set-associative cache of query results keyed by (i, j), to put in front of a
+ * structure whose queries are skewed towards a few hot pairs. Each set holds QUERY_CACHE_WAYS
+ * entries in one cache line, replaced in FIFO order.
+ * Lookups and inserts are lock-free: each set has a version, odd while an insert rewrites it.
+ * A lookup that overlaps an insert into its set is a miss, and an insert into a set that another
+ * thread is rewriting is dropped, so no thread ever waits for another one.
+ * Lookups only read the sets, so that threads hitting the same hot pairs share their lines.
+ * Hits and misses are only counted on request, in counters of their own, striped over cache lines
+ * by thread: they are exact, but cost an atomic increment per lookup.
+ */
+class QueryCache
+{
+public:
+    /**
+     * Constructor. The number of sets is rounded up to a power of two, so the cache may hold
+     * up to twice as many entries as requested.
+     * @param countQueries whether to count hits and misses (see hits() and misses())
+     */
+    explicit QueryCache(size_t entries = QUERY_CACHE_DEFAULT_ENTRIES, bool countQueries = false);
+
+    /**
+     * Looks up the result of (i, j), and counts a hit or a miss if the cache counts its queries.
+     * @return whether the result was found (and stored in result)
+     */
+    bool lookup(int i, int j, int &result);
+
+    /**
+     * Stores the result of (i, j), in place of the oldest entry of its set.
+     */
+    void insert(int i, int j, int result);
+
+    /**
+     * Empties the cache and resets its counters. Not safe concurrently with lookups or inserts.
+     */
+    void clear();
+
+    /**
+     * Returns the number of entries the cache can hold.
+     */
+    size_t capacity() const;
+
+    /**
+     * Return the number of hits and misses since construction or the last clear(), or 0 if the
+     * cache does not count its queries.
+     */
+    uint64_t hits() const;
+    uint64_t misses() const;
+
+private:
+    struct Set
+    {
+        std::atomic<uint64_t> keys[QUERY_CACHE_WAYS];
+        std::atomic<int32_t> results[QUERY_CACHE_WAYS];
+        std::atomic<uint32_t> version; // odd while an insert is rewriting the set
+        char padding[12];              // up to a whole cache line
+    };
+
+    struct Counters
+    {
+        std::atomic<uint64_t> hits;
+        std::atomic<uint64_t> misses;
+        char padding[48]; // up to a whole cache line
+    };
+
+    std::unique_ptr<char[]> storage; // sets, then counters if any, aligned to cache lines within it
+    Set *sets;
+    Counters *counters;              // null if queries are not counted
+    size_t setMask;
+
+    Set &setOf(uint64_t key) const;
+    static Counters &countersOf(Counters *stripes);
+
+    QueryCache(const QueryCache &) = delete;
+    QueryCache &operator=(const QueryCache &) = delete;
+};
+
+/**
+ * A query of Engine, answered through a QueryCache: repeated (i, j) pairs are answered from the
+ * cache, and the others by the engine, which must outlive this object. Invalid pairs are passed
+ * on to the engine, which throws, and are never cached.
+ * query() is thread-safe, as long as the engine's query is.
+ */
+template <typename Engine, int (Engine::*Query)(int, int) const>
+class CachedQuery
+{
+public:
+    explicit CachedQuery(const Engine &engine, size_t entries = QUERY_CACHE_DEFAULT_ENTRIES, bool countQueries = false)
+        : engine(engine), cache(entries, countQueries) {}
+
+    int query(int i, int j)
+    {
+        int result;
+        if (!cache.lookup(i, j, result))
+        {
+            result = (engine.*Query)(i, j);
+            cache.insert(i, j, result);
+        }
+        return result;
+    }
+
+    QueryCache &queryCache() { return cache; }
+
+private:
+    const Engine &engine;
+    QueryCache cache;
+};
+
+/**
+ * Next-node-on-path queries (see NextNodeOnPath::query) through a QueryCache.
+ */
+typedef CachedQuery<NextNodeOnPath, &NextNodeOnPath::query> CachedNextNodeOnPath;
+
+/**
+ * LCA queries (see LCA::lca) through a QueryCache.
+ */
+typedef CachedQuery<LCA, &LCA::lca> CachedLCA;
+
+#endif // QUERYCACHE_HPP
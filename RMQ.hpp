@@ -2,22 +2,51 @@
 #define RMQ_HPP
 
 #include <vector>
-#include "LCA.hpp"
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <algorithm>
+#include <utility>
+#include "Batch.hpp"
+#include "Parallel.hpp"
+#include "Array.hpp"
+#include "Snapshot.hpp"
+
+// Blocks of 32 elements, so that the in-block bitmasks fit in a 32-bit word
+#define RMQ_BLOCK_BITS 5
+#define RMQ_BLOCK_SIZE (1 << RMQ_BLOCK_BITS)
 
 /**
  * Class to perform Range Minimum Queries (RMQ) over a static sequence in O(1) time, after
  * O(n) space and time preprocessing.
- * The RMQ problem is solved by reduction to an LCA problem over a Cartesian Tree built from the sequence,
- * which is again reduced to a simplified "+/-1 RMQ" problem over the depth Euler Tour of the tree.
+ * The sequence is split into blocks of 32 elements. Ranges of whole blocks are answered by a
+ * Sparse Table over the block minima, and ranges within a block by a bitmask per element:
+ * the bitmask of element j marks the positions in its block that are minima of the suffixes
+ * ending at j, so the min over i...j is the lowest marked position at or after i.
+ * Queries only read the preprocessed arrays (Compare must be callable on a const object),
+ * so concurrent queries on one shared instance are safe.
+ * @tparam T type of the sequence elements
+ * @tparam Compare strict weak ordering on T: the "min" is the first element by this ordering
+ *         (std::greater<T> gives range max queries)
+ * @tparam Index unsigned type of the positions stored in the Sparse Table; uint32_t halves
+ *         its memory compared to uint64_t, for sequences of up to 2^32 elements
  */
-class RMQ : private LCA
+template <typename T = int, typename Compare = std::less<T>, typename Index = uint32_t>
+class RMQ
 {
+    friend class NextNodeOnPath;
+
 public:
     /**
      * Constructor. It preprocesses the input sequence to allow for fast RMQ queries.
      * @param seq The input sequence over which RMQs will be performed.
+     * @param threads Maximum number of preprocessing threads (0 means one per hardware thread).
+     * @param comp The ordering of the elements.
+     * @param maxRange If not 0, the maximum length of the query ranges: the Sparse Table only
+     *        covers ranges up to that length, and longer ones are rejected by the queries.
      */
-    RMQ(const std::vector<int> &seq);
+    RMQ(const std::vector<T> &seq, int threads = 0, Compare comp = Compare(), size_t maxRange = 0);
 
     /**
      * Default empty constructor.
@@ -30,10 +59,294 @@ public:
      * @param j Range end index (inclusive).
      * @return Minimum value in the range [i, j].
      */
-    int rangeMin(int i, int j);
+    T rangeMin(Index i, Index j) const;
+
+    /**
+     * Finds the position of the minimum value in the sequence over the range [i, j].
+     * @param i Range start index (inclusive).
+     * @param j Range end index (inclusive).
+     * @return Index of the leftmost minimum in the range [i, j].
+     */
+    Index rangeMinIndex(Index i, Index j) const;
+
+    /**
+     * Saves the preprocessed structure to a snapshot file (see Snapshot.hpp).
+     */
+    void save(const std::string &path) const;
+
+    /**
+     * Loads a structure saved by save() with the same template arguments. The file is
+     * memory-mapped and queries read directly from the mapping, so loading does not depend
+     * on the length of the sequence.
+     * @param verifyChecksums also verify the checksum of every array (reads the whole file)
+     */
+    static RMQ load(const std::string &path, bool verifyChecksums = false);
 
 private:
-    void buildCartesianTree();
+    Array<T> seq;
+    Compare comp;
+
+    // Block-level data
+    Array<uint32_t> inBlockMinMask;              // inBlockMinMask[j]: positions within j's block that are minima of the ranges ending at j
+    std::vector<Array<Index>> pow2Windows;       // Sparse Table: pow2Windows[e] contains min indices for windows of 2^e whole blocks
+
+    void checkRange(Index &i, Index &j) const;
+    Index minIndex(Index i, Index j) const;
+    Index minBySeq(Index i, Index j) const;
+    Index inBlockMinIndex(Index i, Index j) const;
+    Index blockRangeMinIndex(Index k, Index l) const;
+    void rangeMinTile(const int *i, const int *j, int *out, int n) const;
+    void writeState(SnapshotWriter &writer) const;
+    void readState(SnapshotReader &reader);
+
+    // index of the highest set bit of a non-zero word
+    static int highestBit(uint64_t x) { return 63 - __builtin_clzll(x); }
 };
 
-#endif // RMQ_HPP
\ No newline at end of file
+/**
+ * Range Maximum Queries, as RMQ with the reversed ordering.
+ */
+template <typename T = int, typename Index = uint32_t>
+using RangeMaxQuery = RMQ<T, std::greater<T>, Index>;
+
+template <typename T, typename Compare, typename Index>
+RMQ<T, Compare, Index>::RMQ(const std::vector<T> &seq, int threads, Compare comp, size_t maxRange) : seq(seq), comp(comp)
+{
+    if (seq.empty())
+    {
+        throw std::invalid_argument("Input sequence cannot be empty.");
+    }
+    if (seq.size() - 1 > std::numeric_limits<Index>::max())
+    {
+        throw std::invalid_argument("Input sequence is too long for the index type.");
+    }
+
+    size_t size = seq.size();
+    size_t blocks = (size + RMQ_BLOCK_SIZE - 1) >> RMQ_BLOCK_BITS;
+    inBlockMinMask.resize(size);
+    size_t maxWholeBlocks = maxRange > 0 ? std::min(blocks, (maxRange >> RMQ_BLOCK_BITS) + 1) : blocks;
+    pow2Windows.resize(highestBit(maxWholeBlocks) + 1);
+    pow2Windows[0].resize(blocks);
+
+    // for each block, keep a stack of the positions that are minima of the ranges ending at the
+    // current element, as a bitmask: the stack top is the highest set bit
+    parallelFor(blocks, PREPROCESS_THREAD_GRAIN / RMQ_BLOCK_SIZE, threads, [=](size_t firstBlock, size_t lastBlock)
+    {
+        for (size_t b = firstBlock; b < lastBlock; b++)
+        {
+            size_t start = b << RMQ_BLOCK_BITS, end = std::min(start + RMQ_BLOCK_SIZE, size);
+            uint32_t mask = 0;
+            for (size_t j = start; j < end; j++)
+            {
+                // pop the positions with a larger value: they can no longer be a minimum;
+                // equal values stay, so that the leftmost minimum is found
+                while (mask != 0 && this->comp(this->seq[j], this->seq[start + highestBit(mask)]))
+                {
+                    mask &= ~(1u << highestBit(mask));
+                }
+                mask |= 1u << (j - start);
+                inBlockMinMask[j] = mask;
+            }
+
+            // the lowest position left on the stack is the min of the whole block
+            pow2Windows[0][b] = start + __builtin_ctz(mask);
+        }
+    });
+
+    // Build Sparse Table (power-of-two sized windows) on top of the block minima, one level at a time
+    for (int e = 1; e < pow2Windows.size(); e++)
+    {
+        size_t halfWindow = (size_t)1 << (e - 1);
+        pow2Windows[e].resize(blocks - 2 * halfWindow + 1);
+        parallelFor(pow2Windows[e].size(), PREPROCESS_THREAD_GRAIN, threads, [=](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                pow2Windows[e][i] = minBySeq(pow2Windows[e - 1][i], pow2Windows[e - 1][i + halfWindow]);
+            }
+        });
+    }
+}
+
+template <typename T, typename Compare, typename Index>
+T RMQ<T, Compare, Index>::rangeMin(Index i, Index j) const
+{
+    checkRange(i, j);
+    return seq[minIndex(i, j)];
+}
+
+template <typename T, typename Compare, typename Index>
+Index RMQ<T, Compare, Index>::rangeMinIndex(Index i, Index j) const
+{
+    checkRange(i, j);
+    return minIndex(i, j);
+}
+
+// checks the bounds of a query range, and enforces i <= j
+template <typename T, typename Compare, typename Index>
+void RMQ<T, Compare, Index>::checkRange(Index &i, Index &j) const
+{
+    // negative indices converted to Index wrap around, so they are also caught here
+    if (i >= seq.size() || j >= seq.size())
+    {
+        throw std::out_of_range("Index out of bounds.");
+    }
+
+    if (j < i)
+        std::swap(i, j);
+
+    // the whole blocks strictly between i and j must fit in the Sparse Table (see maxRange)
+    if ((j >> RMQ_BLOCK_BITS) - (i >> RMQ_BLOCK_BITS) > ((Index)1 << pow2Windows.size()))
+    {
+        throw std::out_of_range("Range longer than the preprocessed maximum.");
+    }
+}
+
+/*
+Finds the index of the (leftmost) min over the range i...j, with i <= j
+*/
+template <typename T, typename Compare, typename Index>
+Index RMQ<T, Compare, Index>::minIndex(Index i, Index j) const
+{
+    Index iBlock = i >> RMQ_BLOCK_BITS, jBlock = j >> RMQ_BLOCK_BITS;
+
+    if (iBlock == jBlock) // i and j within single block
+    {
+        return inBlockMinIndex(i, j);
+    }
+
+    // i and j not in the same block: the tail of i's block, the whole blocks in between (if any)
+    // and the head of j's block, combined from left to right
+    Index resIndex = inBlockMinIndex(i, (iBlock << RMQ_BLOCK_BITS) + RMQ_BLOCK_SIZE - 1);
+    if (jBlock > iBlock + 1)
+    {
+        resIndex = minBySeq(resIndex, blockRangeMinIndex(iBlock + 1, jBlock - 1));
+    }
+    return minBySeq(resIndex, inBlockMinIndex(jBlock << RMQ_BLOCK_BITS, j));
+}
+
+/*
+Finds the index of the min over i...j within a single block: the lowest position at or after i
+among the minima of the ranges ending at j
+*/
+template <typename T, typename Compare, typename Index>
+Index RMQ<T, Compare, Index>::inBlockMinIndex(Index i, Index j) const
+{
+    Index start = j & ~(Index)(RMQ_BLOCK_SIZE - 1);
+    return start + __builtin_ctz(inBlockMinMask[j] & (~0u << (i - start)));
+}
+
+/*
+Computes the min across a range of whole blocks k...l, from two overlapping windows of the Sparse Table
+*/
+template <typename T, typename Compare, typename Index>
+Index RMQ<T, Compare, Index>::blockRangeMinIndex(Index k, Index l) const
+{
+    int e = highestBit(l - k + 1);
+    return minBySeq(pow2Windows[e][k], pow2Windows[e][l + 1 - ((Index)1 << e)]);
+}
+
+// finds which index (i or j) corresponds to the minimum value, preferring i (the leftmost) on ties
+template <typename T, typename Compare, typename Index>
+Index RMQ<T, Compare, Index>::minBySeq(Index i, Index j) const
+{
+    return comp(seq[j], seq[i]) ? j : i;
+}
+
+/*
+Answers up to BATCH_TILE_SIZE unchecked range min queries over [i[q], j[q]], with i[q] <= j[q], in tile stages
+*/
+template <typename T, typename Compare, typename Index>
+void RMQ<T, Compare, Index>::rangeMinTile(const int *i, const int *j, int *out, int n) const
+{
+    for (int q = 0; q < n; q++)
+    {
+        prefetch(&inBlockMinMask[j[q]]);
+        Index iBlock = i[q] >> RMQ_BLOCK_BITS, jBlock = j[q] >> RMQ_BLOCK_BITS;
+        if (jBlock > iBlock)
+        {
+            prefetch(&inBlockMinMask[i[q] | (RMQ_BLOCK_SIZE - 1)]);
+        }
+        if (jBlock > iBlock + 1)
+        {
+            int e = highestBit(jBlock - iBlock - 1);
+            prefetch(&pow2Windows[e][iBlock + 1]);
+            prefetch(&pow2Windows[e][jBlock - ((Index)1 << e)]);
+        }
+    }
+
+    Index minIndices[BATCH_TILE_SIZE];
+    for (int q = 0; q < n; q++)
+    {
+        minIndices[q] = minIndex(i[q], j[q]);
+        prefetch(&seq[minIndices[q]]);
+    }
+
+    for (int q = 0; q < n; q++)
+    {
+        out[q] = seq[minIndices[q]];
+    }
+}
+
+template <typename T, typename Compare, typename Index>
+void RMQ<T, Compare, Index>::save(const std::string &path) const
+{
+    SnapshotWriter writer(SNAPSHOT_RMQ);
+    writeState(writer);
+    writer.save(path);
+}
+
+template <typename T, typename Compare, typename Index>
+RMQ<T, Compare, Index> RMQ<T, Compare, Index>::load(const std::string &path, bool verifyChecksums)
+{
+    SnapshotReader reader(path, SNAPSHOT_RMQ, verifyChecksums);
+    RMQ rmq;
+    rmq.readState(reader);
+    return rmq;
+}
+
+// writes every array needed by queries, in the order readState() expects them
+template <typename T, typename Compare, typename Index>
+void RMQ<T, Compare, Index>::writeState(SnapshotWriter &writer) const
+{
+    writer.template writeValue<uint32_t>(pow2Windows.size());
+    writer.write(seq);
+    writer.write(inBlockMinMask);
+    for (const Array<Index> &level : pow2Windows)
+    {
+        writer.write(level);
+    }
+}
+
+template <typename T, typename Compare, typename Index>
+void RMQ<T, Compare, Index>::readState(SnapshotReader &reader)
+{
+    uint32_t levels = reader.template readValue<uint32_t>();
+    if (levels == 0 || levels > 64)
+    {
+        throw std::runtime_error("Snapshot has an invalid number of RMQ Sparse Table levels.");
+    }
+    pow2Windows.resize(levels);
+    reader.read(seq);
+    reader.read(inBlockMinMask);
+    for (Array<Index> &level : pow2Windows)
+    {
+        reader.read(level);
+    }
+
+    // the array lengths must be those of the constructor (levels may stop early, see maxRange),
+    // so that queries stay within them; their contents are only covered by the checksums
+    size_t blocks = (seq.size() + RMQ_BLOCK_SIZE - 1) >> RMQ_BLOCK_BITS;
+    bool consistent = !seq.empty() && inBlockMinMask.size() == seq.size() && pow2Windows[0].size() == blocks &&
+                      levels <= (uint32_t)highestBit(blocks) + 1;
+    for (uint32_t e = 1; consistent && e < levels; e++)
+    {
+        consistent = pow2Windows[e].size() == blocks - ((size_t)1 << e) + 1;
+    }
+    if (!consistent)
+    {
+        throw std::runtime_error("Snapshot has inconsistent RMQ array lengths.");
+    }
+}
+
+#endif // RMQ_HPP
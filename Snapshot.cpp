@@ -0,0 +1,182 @@
+#include "Snapshot.hpp"
+#include <fstream>
+#include <stdexcept>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char SNAPSHOT_MAGIC[8] = {'N', 'N', 'O', 'P', 'S', 'N', 'A', 'P'};
+
+uint64_t snapshotChecksum(const void *data, size_t bytes, uint64_t seed)
+{
+    const char *p = (const char *)data;
+    uint64_t h = seed ^ 0xcbf29ce484222325ULL;
+    for (; bytes >= 8; p += 8, bytes -= 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, p, 8);
+        h = (h ^ word) * 0x100000001b3ULL;
+        h ^= h >> 29;
+    }
+    for (; bytes > 0; p++, bytes--)
+    {
+        h = (h ^ (unsigned char)*p) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// checksum of the header (with its checksum field cleared) followed by the section table
+static uint64_t headerChecksum(SnapshotHeader header, const SnapshotSection *sections)
+{
+    header.checksum = 0;
+    uint64_t h = snapshotChecksum(&header, sizeof(header));
+    return snapshotChecksum(sections, header.sectionCount * sizeof(SnapshotSection), h);
+}
+
+SnapshotWriter::SnapshotWriter(SnapshotKind kind) : kind(kind)
+{
+}
+
+void SnapshotWriter::addSection(const void *data, size_t count, size_t elementSize)
+{
+    SnapshotSection section;
+    section.offset = 0; // assigned by save()
+    section.count = count;
+    section.elementSize = elementSize;
+    section.checksum = snapshotChecksum(data, count * elementSize);
+    sections.push_back(section);
+    payloads.push_back(data);
+}
+
+static uint64_t alignUp(uint64_t offset)
+{
+    return (offset + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+}
+
+void SnapshotWriter::save(const std::string &path)
+{
+    // lay out the sections after the header and the section table
+    uint64_t offset = sizeof(SnapshotHeader) + sections.size() * sizeof(SnapshotSection);
+    for (SnapshotSection &section : sections)
+    {
+        section.offset = alignUp(offset);
+        offset = section.offset + section.count * section.elementSize;
+    }
+
+    SnapshotHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.kind = kind;
+    header.byteOrder = SNAPSHOT_BYTE_ORDER;
+    header.sectionCount = sections.size();
+    header.fileSize = offset;
+    header.checksum = headerChecksum(header, sections.data());
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        throw std::runtime_error("Cannot open snapshot file for writing: " + path);
+    }
+    file.write((const char *)&header, sizeof(header));
+    file.write((const char *)sections.data(), sections.size() * sizeof(SnapshotSection));
+
+    uint64_t position = sizeof(SnapshotHeader) + sections.size() * sizeof(SnapshotSection);
+    const char padding[SNAPSHOT_ALIGNMENT] = {};
+    for (int s = 0; s < sections.size(); s++)
+    {
+        file.write(padding, sections[s].offset - position);
+        file.write((const char *)payloads[s], sections[s].count * sections[s].elementSize);
+        position = sections[s].offset + sections[s].count * sections[s].elementSize;
+    }
+
+    if (!file.flush())
+    {
+        throw std::runtime_error("Cannot write snapshot file: " + path);
+    }
+}
+
+SnapshotReader::SnapshotReader(const std::string &path, SnapshotKind kind, bool verifyChecksums) : next(0)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Cannot open snapshot file: " + path);
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size < sizeof(SnapshotHeader))
+    {
+        close(fd);
+        throw std::runtime_error("Snapshot file is truncated: " + path);
+    }
+    size_t fileSize = fileStat.st_size;
+    void *address = mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // the mapping stays valid after the descriptor is closed
+    if (address == MAP_FAILED)
+    {
+        throw std::runtime_error("Cannot map snapshot file: " + path);
+    }
+    mapping = std::shared_ptr<const void>(address, [fileSize](const void *p) { munmap(const_cast<void *>(p), fileSize); });
+    base = (const char *)address;
+
+    SnapshotHeader header;
+    std::memcpy(&header, base, sizeof(header));
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0)
+    {
+        throw std::runtime_error("Not a snapshot file: " + path);
+    }
+    if (header.version != SNAPSHOT_VERSION)
+    {
+        throw std::runtime_error("Unsupported snapshot version: " + path);
+    }
+    if (header.byteOrder != SNAPSHOT_BYTE_ORDER)
+    {
+        throw std::runtime_error("Snapshot was written with a different byte order: " + path);
+    }
+    if (header.kind != kind)
+    {
+        throw std::runtime_error("Snapshot holds a different kind of structure: " + path);
+    }
+    if (header.fileSize != fileSize ||
+        sizeof(SnapshotHeader) + (uint64_t)header.sectionCount * sizeof(SnapshotSection) > fileSize)
+    {
+        throw std::runtime_error("Snapshot file is truncated: " + path);
+    }
+
+    sections = (const SnapshotSection *)(base + sizeof(SnapshotHeader));
+    sectionCount = header.sectionCount;
+    if (headerChecksum(header, sections) != header.checksum)
+    {
+        throw std::runtime_error("Snapshot header checksum mismatch: " + path);
+    }
+
+    for (uint32_t s = 0; s < sectionCount; s++)
+    {
+        const SnapshotSection &section = sections[s];
+        if (section.offset % SNAPSHOT_ALIGNMENT != 0 || section.offset > fileSize || section.elementSize == 0 ||
+            section.count > (fileSize - section.offset) / section.elementSize)
+        {
+            throw std::runtime_error("Snapshot section out of bounds: " + path);
+        }
+        if (verifyChecksums && snapshotChecksum(base + section.offset, section.count * section.elementSize) != section.checksum)
+        {
+            throw std::runtime_error("Snapshot section checksum mismatch: " + path);
+        }
+    }
+}
+
+const SnapshotSection &SnapshotReader::nextSection(size_t elementSize)
+{
+    if (next >= sectionCount)
+    {
+        throw std::runtime_error("Snapshot has fewer sections than expected.");
+    }
+    const SnapshotSection &section = sections[next++];
+    if (section.elementSize != elementSize)
+    {
+        throw std::runtime_error("Snapshot section has an unexpected element type.");
+    }
+    return section;
+}
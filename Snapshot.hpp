@@ -0,0 +1,144 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+#include <stdexcept>
+#include <cstring>
+#include "Array.hpp"
+
+/*
+Snapshot file layout (native byte order, version SNAPSHOT_VERSION):
+    SnapshotHeader
+    SnapshotSection[sectionCount]
+    section payloads, each aligned to SNAPSHOT_ALIGNMENT bytes
+The header checksum covers the header (with the checksum field set to 0) and the section table,
+and is always verified on load; each section carries the checksum of its own payload.
+*/
+#define SNAPSHOT_VERSION 4 // 4: LCA power-of-two blocks; 3: NextNodeOnPath node order and records; 2: LCA in-block tables no longer stored
+#define SNAPSHOT_ALIGNMENT 64
+#define SNAPSHOT_BYTE_ORDER 0x01020304
+
+// Kind of structure stored in a snapshot
+enum SnapshotKind : uint32_t
+{
+    SNAPSHOT_LCA = 1,
+    SNAPSHOT_RMQ = 2,
+    SNAPSHOT_NEXT_NODE_ON_PATH = 3
+};
+
+struct SnapshotHeader
+{
+    char magic[8]; // "NNOPSNAP"
+    uint32_t version;
+    uint32_t kind;
+    uint32_t byteOrder; // SNAPSHOT_BYTE_ORDER, as written by the producing machine
+    uint32_t sectionCount;
+    uint64_t fileSize;
+    uint64_t checksum;
+};
+
+struct SnapshotSection
+{
+    uint64_t offset; // from the start of the file
+    uint64_t count;  // number of elements
+    uint64_t elementSize;
+    uint64_t checksum;
+};
+
+/**
+ * Checksum of a byte range, processed one 64-bit word at a time.
+ */
+uint64_t snapshotChecksum(const void *data, size_t bytes, uint64_t seed = 0);
+
+/**
+ * Collects arrays to be written as the sections of a snapshot file. The arrays are not copied:
+ * they must stay alive until save() returns.
+ */
+class SnapshotWriter
+{
+public:
+    SnapshotWriter(SnapshotKind kind);
+
+    template <typename T>
+    void write(const Array<T> &a)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Snapshot arrays must be trivially copyable.");
+        addSection(a.data(), a.size(), sizeof(T));
+    }
+
+    /**
+     * Writes a single value, stored as a one-element section.
+     */
+    template <typename T>
+    void writeValue(T value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Snapshot values must be trivially copyable.");
+        values.push_back(std::vector<char>((const char *)&value, (const char *)&value + sizeof(T)));
+        addSection(values.back().data(), 1, sizeof(T));
+    }
+
+    /**
+     * Writes the header, the section table and every section to the file at path.
+     */
+    void save(const std::string &path);
+
+private:
+    SnapshotKind kind;
+    std::vector<const void *> payloads;
+    std::vector<SnapshotSection> sections;
+    std::vector<std::vector<char>> values;
+
+    void addSection(const void *data, size_t count, size_t elementSize);
+};
+
+/**
+ * Maps a snapshot file read-only and hands out its sections, in the order they were written,
+ * as arrays that point directly into the mapping (no copy). The mapping stays alive as long as
+ * any of those arrays does.
+ */
+class SnapshotReader
+{
+public:
+    /**
+     * Maps and validates the file at path: magic, version, byte order, kind, header checksum
+     * and section bounds. Payload checksums are only verified if verifyChecksums is set,
+     * since that reads the whole file.
+     */
+    SnapshotReader(const std::string &path, SnapshotKind kind, bool verifyChecksums = false);
+
+    template <typename T>
+    void read(Array<T> &a)
+    {
+        const SnapshotSection &section = nextSection(sizeof(T));
+        a = Array<T>::borrow((const T *)(base + section.offset), section.count, mapping);
+    }
+
+    template <typename T>
+    T readValue()
+    {
+        const SnapshotSection &section = nextSection(sizeof(T));
+        if (section.count != 1)
+        {
+            throw std::runtime_error("Snapshot section does not hold a single value.");
+        }
+        T value;
+        std::memcpy(&value, base + section.offset, sizeof(T));
+        return value;
+    }
+
+private:
+    std::shared_ptr<const void> mapping;
+    const char *base;
+    const SnapshotSection *sections;
+    uint32_t sectionCount;
+    uint32_t next;
+
+    const SnapshotSection &nextSection(size_t elementSize);
+};
+
+#endif // SNAPSHOT_HPP
@@ -0,0 +1,428 @@
+#include "SuccinctTree.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <climits>
+
+/*
+The excess of position p is the number of open minus closed parentheses in 0...p, i.e. the depth
+of the node entered at p plus one; the position before the sequence has excess 0. All the queries
+come down to finding the nearest position, left or right of p, whose excess reaches a target
+below p's own: since the excess moves by +/-1, that is the first position whose excess is at most
+the target, which the min tree locates block by block and the scans byte by byte.
+*/
+
+// Returned by the scans and searches when no position qualifies
+#define NOT_FOUND INT64_MIN
+
+// Excess over a byte of parentheses (bit 0 first), and min of the excess after each of its bits
+struct ByteExcessTables
+{
+    int8_t excess[256];
+    int8_t minPrefix[256];
+
+    ByteExcessTables()
+    {
+        for (int byte = 0; byte < 256; byte++)
+        {
+            int e = 0, m = 8;
+            for (int t = 0; t < 8; t++)
+            {
+                e += (byte >> t & 1) ? 1 : -1;
+                m = std::min(m, e);
+            }
+            excess[byte] = e;
+            minPrefix[byte] = m;
+        }
+    }
+};
+
+static const ByteExcessTables &byteTables()
+{
+    static const ByteExcessTables tables;
+    return tables;
+}
+
+// position of the (r + 1)-th set bit of word, which has more than r set bits
+static int selectInWord(uint64_t word, int r)
+{
+    int shift = 0;
+    for (int c = __builtin_popcountll(word & 0xFF); r >= c; c = __builtin_popcountll(word & 0xFF))
+    {
+        r -= c;
+        word >>= 8;
+        shift += 8;
+    }
+    for (; r > 0; r--)
+    {
+        word &= word - 1;
+    }
+    return shift + __builtin_ctzll(word);
+}
+
+SuccinctTree::SuccinctTree(const TreeView &tree, std::vector<int> *preOrder) : nodes(tree.size), length(2 * (size_t)tree.size)
+{
+    // depth-first walk writing the parentheses, with a stack of
+    // (node, position in tree.childList of the next child to visit)
+    bits.assign(length / 64 + 1, 0);
+    if (preOrder)
+    {
+        preOrder->clear();
+        preOrder->reserve(nodes);
+    }
+    std::vector<std::pair<int, int>> stack;
+    stack.push_back(std::make_pair(tree.root, tree.childOffsets[tree.root]));
+    bits[0] = 1;
+    if (preOrder)
+    {
+        preOrder->push_back(tree.root);
+    }
+    size_t p = 1;
+    while (!stack.empty())
+    {
+        int node = stack.back().first;
+        int nextChild = stack.back().second;
+        if (nextChild < tree.childOffsets[node + 1])
+        {
+            int child = tree.childList[nextChild];
+            stack.back().second++;
+            stack.push_back(std::make_pair(child, tree.childOffsets[child]));
+            bits[p >> 6] |= 1ULL << (p & 63);
+            if (preOrder)
+            {
+                preOrder->push_back(child);
+            }
+        }
+        else
+        {
+            stack.pop_back();
+        }
+        p++;
+    }
+
+    // rank directory and select samples
+    size_t blocks = (length + SUCCINCT_BLOCK_BITS - 1) / SUCCINCT_BLOCK_BITS;
+    const size_t wordsPerBlock = SUCCINCT_BLOCK_BITS / 64;
+    rankSamples.resize(blocks + 1);
+    rankSamples[0] = 0;
+    size_t nextSample = 0;
+    for (size_t b = 0; b < blocks; b++)
+    {
+        uint32_t ones = 0;
+        for (size_t w = b * wordsPerBlock; w < std::min((b + 1) * wordsPerBlock, bits.size()); w++)
+        {
+            ones += __builtin_popcountll(bits[w]);
+        }
+        rankSamples[b + 1] = rankSamples[b] + ones;
+        for (; nextSample < rankSamples[b + 1]; nextSample += SUCCINCT_SELECT_SAMPLE)
+        {
+            selectSamples.push_back(b);
+        }
+    }
+
+    // min tree over the blocks
+    leafCount = 1;
+    while (leafCount < blocks)
+    {
+        leafCount *= 2;
+    }
+    minTree.assign(2 * leafCount, INT32_MAX);
+    int64_t e = 0;
+    for (size_t b = 0; b < blocks; b++)
+    {
+        size_t end = std::min((b + 1) * SUCCINCT_BLOCK_BITS, length);
+        minTree[leafCount + b] = scanMin(b * SUCCINCT_BLOCK_BITS, end, e);
+        e = excess(end - 1);
+    }
+    for (size_t v = leafCount - 1; v >= 1; v--)
+    {
+        minTree[v] = std::min(minTree[2 * v], minTree[2 * v + 1]);
+    }
+}
+
+int SuccinctTree::parent(int v) const
+{
+    checkIndex(v);
+    size_t open = select(v);
+    int64_t q = backwardSearch(open, excess(open) - 2);
+    return q == NOT_FOUND ? -1 : rank(q + 1);
+}
+
+int SuccinctTree::depth(int v) const
+{
+    checkIndex(v);
+    return excess(select(v)) - 1;
+}
+
+int SuccinctTree::lca(int i, int j) const
+{
+    checkIndex(i);
+    checkIndex(j);
+    size_t a = select(i), b = select(j);
+    if (b < a)
+    {
+        std::swap(a, b);
+        std::swap(i, j);
+    }
+
+    // the min excess between the two nodes is the LCA's, and the LCA is open since just after
+    // the last position before a with one less
+    int64_t minExcess = rangeMinExcess(a, b);
+    if (minExcess == excess(a)) // i is an ancestor of j
+    {
+        return i;
+    }
+    return rank(backwardSearch(a, minExcess - 1) + 1);
+}
+
+int SuccinctTree::query(int i, int j) const
+{
+    checkIndex(i);
+    checkIndex(j);
+    if (i == j)
+    {
+        return -1;
+    }
+
+    size_t a = select(i), b = select(j);
+    int64_t e = excess(a);
+    if (a < b && forwardSearch(a, e - 1) > (int64_t)b) // j in i's subtree: descend
+    {
+        // the child holding j is opened just after the last position before b back at i's excess
+        return rank(backwardSearch(b, e) + 1);
+    }
+    // go up: the parent is opened just after the last position before a with excess e - 2
+    return rank(backwardSearch(a, e - 2) + 1);
+}
+
+int SuccinctTree::size() const
+{
+    return nodes;
+}
+
+size_t SuccinctTree::sizeInBytes() const
+{
+    return sizeof(*this) + bits.size() * sizeof(uint64_t) + rankSamples.size() * sizeof(uint32_t) +
+           selectSamples.size() * sizeof(uint32_t) + minTree.size() * sizeof(int32_t);
+}
+
+// number of open parentheses in 0...p - 1
+size_t SuccinctTree::rank(size_t p) const
+{
+    size_t block = p / SUCCINCT_BLOCK_BITS;
+    size_t ones = rankSamples[block];
+    for (size_t w = block * (SUCCINCT_BLOCK_BITS / 64); w < p / 64; w++)
+    {
+        ones += __builtin_popcountll(bits[w]);
+    }
+    if (p & 63)
+    {
+        ones += __builtin_popcountll(bits[p / 64] & ((1ULL << (p & 63)) - 1));
+    }
+    return ones;
+}
+
+/*
+Position of the open parenthesis of node k, i.e. of the (k + 1)-th open parenthesis. Its block lies
+between the blocks of the select samples around k, which may be any number of blocks apart (runs of
+closed parentheses hold no samples), so it is binary searched in the rank directory between them:
+it is the first block whose next rank is above k.
+*/
+size_t SuccinctTree::select(size_t k) const
+{
+    size_t sample = k / SUCCINCT_SELECT_SAMPLE;
+    size_t first = selectSamples[sample];
+    size_t last = sample + 1 < selectSamples.size() ? selectSamples[sample + 1] : rankSamples.size() - 2;
+    const uint32_t *ranks = rankSamples.data();
+    size_t block = std::upper_bound(ranks + first + 1, ranks + last + 1, k) - (ranks + 1);
+    size_t r = k - rankSamples[block];
+    size_t w = block * (SUCCINCT_BLOCK_BITS / 64);
+    for (size_t ones = __builtin_popcountll(bits[w]); r >= ones; ones = __builtin_popcountll(bits[w]))
+    {
+        r -= ones;
+        w++;
+    }
+    return w * 64 + selectInWord(bits[w], r);
+}
+
+int64_t SuccinctTree::excess(int64_t p) const
+{
+    return p < 0 ? 0 : 2 * (int64_t)rank(p + 1) - (p + 1);
+}
+
+// first position in from...to - 1 with excess target, given the excess before from
+int64_t SuccinctTree::scanForward(size_t from, size_t to, int64_t excessBefore, int64_t target) const
+{
+    const ByteExcessTables &tables = byteTables();
+    int64_t e = excessBefore;
+    for (size_t p = from; p < to;)
+    {
+        if ((p & 7) == 0 && p + 8 <= to)
+        {
+            uint8_t byte = bits[p >> 6] >> (p & 63);
+            if (e + tables.minPrefix[byte] > target)
+            {
+                e += tables.excess[byte];
+                p += 8;
+                continue;
+            }
+        }
+        e += bit(p) ? 1 : -1;
+        if (e == target)
+        {
+            return p;
+        }
+        p++;
+    }
+    return NOT_FOUND;
+}
+
+// last position in from...to with excess target, given the excess at to
+int64_t SuccinctTree::scanBackward(size_t from, size_t to, int64_t excessAtEnd, int64_t target) const
+{
+    const ByteExcessTables &tables = byteTables();
+    int64_t e = excessAtEnd;
+    for (int64_t p = to; p >= (int64_t)from;)
+    {
+        if ((p & 7) == 7 && p - 7 >= (int64_t)from)
+        {
+            uint8_t byte = bits[p >> 6] >> ((p - 7) & 63);
+            int64_t before = e - tables.excess[byte];
+            if (before + tables.minPrefix[byte] > target)
+            {
+                e = before;
+                p -= 8;
+                continue;
+            }
+        }
+        if (e == target)
+        {
+            return p;
+        }
+        e -= bit(p) ? 1 : -1;
+        p--;
+    }
+    return NOT_FOUND;
+}
+
+// min excess over from...to - 1, given the excess before from
+int64_t SuccinctTree::scanMin(size_t from, size_t to, int64_t excessBefore) const
+{
+    const ByteExcessTables &tables = byteTables();
+    int64_t e = excessBefore, minExcess = INT64_MAX;
+    for (size_t p = from; p < to;)
+    {
+        if ((p & 7) == 0 && p + 8 <= to)
+        {
+            uint8_t byte = bits[p >> 6] >> (p & 63);
+            minExcess = std::min(minExcess, e + tables.minPrefix[byte]);
+            e += tables.excess[byte];
+            p += 8;
+            continue;
+        }
+        e += bit(p) ? 1 : -1;
+        minExcess = std::min(minExcess, e);
+        p++;
+    }
+    return minExcess;
+}
+
+/*
+First position after p with excess target, below p's: the rest of p's block is scanned, then the
+min tree leads to the first block after it whose min reaches the target, which is scanned in turn.
+*/
+int64_t SuccinctTree::forwardSearch(size_t p, int64_t target) const
+{
+    size_t block = p / SUCCINCT_BLOCK_BITS;
+    int64_t q = scanForward(p + 1, std::min((block + 1) * SUCCINCT_BLOCK_BITS, length), excess(p), target);
+    if (q != NOT_FOUND)
+    {
+        return q;
+    }
+
+    // climb until a right sibling reaches the target, then descend to its leftmost such leaf
+    size_t v = leafCount + block;
+    while (v > 1 && ((v & 1) || minTree[v + 1] > target))
+    {
+        v >>= 1;
+    }
+    if (v == 1)
+    {
+        return NOT_FOUND;
+    }
+    for (v++; v < leafCount;)
+    {
+        v = minTree[2 * v] <= target ? 2 * v : 2 * v + 1;
+    }
+    size_t start = (v - leafCount) * SUCCINCT_BLOCK_BITS;
+    return scanForward(start, std::min(start + SUCCINCT_BLOCK_BITS, length), excess((int64_t)start - 1), target);
+}
+
+/*
+Last position before p with excess target, below that of p - 1, found like in forwardSearch but
+leftwards. The position before the sequence has excess 0, so -1 is returned for a target of 0.
+*/
+int64_t SuccinctTree::backwardSearch(size_t p, int64_t target) const
+{
+    if (p > 0)
+    {
+        size_t block = (p - 1) / SUCCINCT_BLOCK_BITS;
+        int64_t q = scanBackward(block * SUCCINCT_BLOCK_BITS, p - 1, excess(p - 1), target);
+        if (q != NOT_FOUND)
+        {
+            return q;
+        }
+
+        size_t v = leafCount + block;
+        while (v > 1 && (!(v & 1) || minTree[v - 1] > target))
+        {
+            v >>= 1;
+        }
+        if (v > 1)
+        {
+            for (v--; v < leafCount;)
+            {
+                v = minTree[2 * v + 1] <= target ? 2 * v + 1 : 2 * v;
+            }
+            size_t start = (v - leafCount) * SUCCINCT_BLOCK_BITS;
+            size_t end = std::min(start + SUCCINCT_BLOCK_BITS, length) - 1;
+            return scanBackward(start, end, excess(end), target);
+        }
+    }
+    return target == 0 ? -1 : NOT_FOUND;
+}
+
+// min excess over from...to
+int64_t SuccinctTree::rangeMinExcess(size_t from, size_t to) const
+{
+    size_t firstBlock = from / SUCCINCT_BLOCK_BITS, lastBlock = to / SUCCINCT_BLOCK_BITS;
+    if (firstBlock == lastBlock)
+    {
+        return scanMin(from, to + 1, excess((int64_t)from - 1));
+    }
+
+    size_t lastStart = lastBlock * SUCCINCT_BLOCK_BITS;
+    int64_t minExcess = std::min(scanMin(from, (firstBlock + 1) * SUCCINCT_BLOCK_BITS, excess((int64_t)from - 1)),
+                                 scanMin(lastStart, to + 1, excess((int64_t)lastStart - 1)));
+    // whole blocks in between, bottom-up over the min tree
+    for (size_t l = leafCount + firstBlock + 1, r = leafCount + lastBlock; l < r; l >>= 1, r >>= 1)
+    {
+        if (l & 1)
+        {
+            minExcess = std::min<int64_t>(minExcess, minTree[l++]);
+        }
+        if (r & 1)
+        {
+            minExcess = std::min<int64_t>(minExcess, minTree[--r]);
+        }
+    }
+    return minExcess;
+}
+
+void SuccinctTree::checkIndex(int v) const
+{
+    if (v < 0 || v >= nodes)
+    {
+        throw std::out_of_range("Index out of bounds.");
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef SUCCINCTTREE_HPP
+#define SUCCINCTTREE_HPP
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "CSRTree.hpp"
+#include "Array.hpp"
+
+// Bits per block of the rank directory and of the range min tree
+#define SUCCINCT_BLOCK_BITS 512
+// Ones (nodes) between consecutive select samples
+#define SUCCINCT_SELECT_SAMPLE 4096
+
+/**
+ * Compact alternative to NextNodeOnPath for very large trees, trading query time for memory.
+ * The tree is stored as its balanced parentheses sequence (2 bits per node: an open parenthesis
+ * when a node is entered in a depth-first walk, a closed one when it is left), plus a rank
+ * directory, select samples and a range min tree over the excess (depth) of each block:
+ * about 2.6 bits per node in all, against tens of bytes for NextNodeOnPath.
+ * Parent, depth, LCA and next-node-on-path queries take O(log n) time, as binary searches of the
+ * rank directory and searches over the range min tree, followed by scans of at most two blocks.
+ * Nodes are numbered in pre-order (children in CSR order); the constructor can return the
+ * original index of each of them. Queries are const and thread-safe.
+ */
+class SuccinctTree
+{
+public:
+    /**
+     * Constructor. It encodes the tree given by a CSR view, which is not needed afterwards.
+     * @param preOrder if not null, receives the index in tree of each node, in pre-order
+     */
+    SuccinctTree(const TreeView &tree, std::vector<int> *preOrder = nullptr);
+
+    /**
+     * Returns the parent of node v, or -1 for the root.
+     */
+    int parent(int v) const;
+
+    /**
+     * Returns the depth of node v (the root has depth 0).
+     */
+    int depth(int v) const;
+
+    /**
+     * Finds the LCA between nodes i and j.
+     */
+    int lca(int i, int j) const;
+
+    /**
+     * Finds the next node on the unique path between nodes i and j.
+     * @return next-node-on-path(i, j), or -1 if i == j
+     */
+    int query(int i, int j) const;
+
+    /**
+     * Returns the number of nodes.
+     */
+    int size() const;
+
+    /**
+     * Returns the memory taken by the encoding, in bytes.
+     */
+    size_t sizeInBytes() const;
+
+private:
+    int nodes;
+    size_t length; // 2 * nodes parentheses
+
+    Array<uint64_t> bits;          // bit p set iff parenthesis p is open
+    Array<uint32_t> rankSamples;   // number of open parentheses before each block
+    Array<uint32_t> selectSamples; // block holding open parenthesis k * SUCCINCT_SELECT_SAMPLE
+    Array<int32_t> minTree;        // heap-ordered min tree over the blocks' minimum excess
+    size_t leafCount;              // leaves of minTree, a power of two
+
+    bool bit(size_t p) const { return bits[p >> 6] >> (p & 63) & 1; }
+    size_t rank(size_t p) const;
+    size_t select(size_t k) const;
+    int64_t excess(int64_t p) const;
+    int64_t scanForward(size_t from, size_t to, int64_t excessBefore, int64_t target) const;
+    int64_t scanBackward(size_t from, size_t to, int64_t excessAtEnd, int64_t target) const;
+    int64_t scanMin(size_t from, size_t to, int64_t excessBefore) const;
+    int64_t forwardSearch(size_t p, int64_t target) const;
+    int64_t backwardSearch(size_t p, int64_t target) const;
+    int64_t rangeMinExcess(size_t from, size_t to) const;
+    void checkIndex(int v) const;
+};
+
+#endif // SUCCINCTTREE_HPP
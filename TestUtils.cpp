@@ -2,15 +2,87 @@
 #include "RMQ.hpp"
 #include "LCA.hpp"
 #include "NextNodeOnPath.hpp"
+#include "DynamicTree.hpp"
+#include "IncrementalNextNodeOnPath.hpp"
+#include "Forest.hpp"
+#include "BlockKernels.hpp"
+#include "Memory.hpp"
+#include "SuccinctTree.hpp"
+#include "PathAggregate.hpp"
+#include "EulerNextNodeOnPath.hpp"
+#include "OfflineQueries.hpp"
+#include "TreeLoader.hpp"
+#include "QueryCache.hpp"
+#include "Snapshot.hpp"
+#include "BenchUtils.hpp"
 #include <iostream>
+#include <algorithm>
 #include <fstream>
 #include <ctime>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <iterator>
+#include <cstring>
 
 #define MAX_RMQ_TEST_SEQ_LENGTH 500
 #define MAX_NNOP_TEST_TREE_SIZE 500
+#define NNOP_TEST_DEEP_TREE_SIZE 2000000
+#define NNOP_TEST_DEEP_QUERIES 100000
+#define CONCURRENT_TEST_TREE_SIZE 500
+#define CONCURRENT_TEST_THREADS 64
+#define DYNAMIC_TEST_UPDATES 2000
+#define DYNAMIC_TEST_QUERIES_PER_UPDATE 50
+#define INCREMENTAL_TEST_LEAVES 5000
+#define INCREMENTAL_TEST_REBUILD_THRESHOLD 200
+#define INCREMENTAL_TEST_READERS 2
+#define FOREST_TEST_TREES 300
+#define MAX_FOREST_TEST_TREE_SIZE 60
+#define MAX_KERNEL_TEST_LENGTH 2000
+#define RELABEL_TEST_TREES 100
+#define MAX_RELABEL_TEST_TREE_SIZE 120
+#define MEMORY_TEST_TREE_SIZE 500000
+#define MEMORY_TEST_QUERIES 200000
+#define SUCCINCT_TEST_TREES 40
+#define MAX_SUCCINCT_TEST_TREE_SIZE 12000
+#define SUCCINCT_TEST_PAIRS 10000
+#define SUCCINCT_TEST_CHAINS 3
+#define SUCCINCT_TEST_CHAIN_LENGTH 300000
+#define PATH_AGGREGATE_TEST_TREES 40
+#define MAX_PATH_AGGREGATE_TEST_TREE_SIZE 20000
+#define PATH_AGGREGATE_TEST_PAIRS 5000
+#define EULER_TEST_TREES 40
+#define MAX_EULER_TEST_TREE_SIZE 20000
+#define EULER_TEST_PAIRS 5000
+#define OFFLINE_TEST_TREES 40
+#define MAX_OFFLINE_TEST_TREE_SIZE 20000
+#define OFFLINE_TEST_PAIRS 40000
+#define OFFLINE_TEST_THREADS 4
+#define CACHE_TEST_TREES 40
+#define MAX_CACHE_TEST_TREE_SIZE 20000
+#define CACHE_TEST_QUERIES 40000
+#define CACHE_TEST_HOT_PAIRS 64
+#define CACHE_TEST_THREADS 8
+#define LOADER_TEST_TREES 20
+#define MAX_LOADER_TEST_TREE_SIZE 3000
+#define LOADER_TEST_LARGE_TREE_SIZE (1 << 20)
 
 #define EXPORT_TO_CSV false
 
+#define SNAPSHOT_TEST_FILE "NNOP_snapshot_test.bin"
+#define LOADER_TEST_FILE "NNOP_loader_test.tree"
+
+// receives the results of timed queries, so that they are not optimised away
+static volatile long querySink;
+
+// microseconds elapsed since start, on a steady clock
+static double elapsedMicroseconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
 void testRMQ()
 {
     std::cout << "+++ Testing the RMQ data structure against random sequences of length up to " << MAX_RMQ_TEST_SEQ_LENGTH << " +++\n";
@@ -27,7 +99,8 @@ void testRMQ()
     }
 
     std::vector<int> seq;
-    int totalCorrect = 0, total = 0;
+    std::vector<int64_t> wideSeq;
+    int totalCorrect = 0, total = 0, totalArgMaxCorrect = 0;
     for (int sequenceLength = 1; sequenceLength <= MAX_RMQ_TEST_SEQ_LENGTH; sequenceLength++)
     {
         if (sequenceLength % 50 == 0)
@@ -39,21 +112,26 @@ void testRMQ()
         {
             seq[i] = std::rand() % 201 - 100; // random int in [-100, 100] range
         }
+        wideSeq.assign(seq.begin(), seq.end());
+        for (int64_t &x : wideSeq)
+        {
+            x <<= 32; // beyond the int range
+        }
 
         // preprocess sequence for RMQ queries
-        clock_t startPreprocess = clock();
-        RMQ rmq(seq);
-        clock_t endPreprocess = clock();
-        double preprocessTime = 1000000.0 * (double)(endPreprocess - startPreprocess) / (double)CLOCKS_PER_SEC; // microseconds
+        std::chrono::steady_clock::time_point startPreprocess = std::chrono::steady_clock::now();
+        RMQ<int> rmq(seq);
+        double preprocessTime = elapsedMicroseconds(startPreprocess);
 
         if (EXPORT_TO_CSV) {
             preprocessFile << sequenceLength << "," << preprocessTime << "\n";
         }
 
+        // range argmax over 64-bit keys, with 64-bit indices
+        RangeMaxQuery<int64_t, uint64_t> argMaxRmq(wideSeq);
+
         // test RMQ queries on current sequence
         int correct = 0, wrong = 0;
-        double totalQueryTime = 0;
-        int queryCount = 0;
         for (int i = 0; i < seq.size(); i++)
         {
             for (int j = 0; j < seq.size(); j++)
@@ -71,16 +149,15 @@ void testRMQ()
                     l = i;
                 }
 
-                int m = seq[k];
+                int m = seq[k], argMax = k;
                 for (int q = k + 1; q <= l; q++)
+                {
                     m = std::min(m, seq[q]);
+                    if (seq[q] > seq[argMax])
+                        argMax = q;
+                }
 
-                clock_t startQuery = clock();
                 int res = rmq.rangeMin(i, j);
-                clock_t endQuery = clock();
-                double queryTime = ((double)(endQuery - startQuery) / (double)CLOCKS_PER_SEC) * 1000000; // microseconds
-                totalQueryTime += queryTime;
-                queryCount++;
 
                 if (m == res)
                 {
@@ -90,12 +167,28 @@ void testRMQ()
                 {
                     wrong++;
                 }
+
+                if (argMaxRmq.rangeMinIndex(i, j) == argMax)
+                {
+                    totalArgMaxCorrect++;
+                }
             }
         }
 
-        double averageQueryTime = totalQueryTime / queryCount;
+        // time all the queries in a separate pass: a single query is shorter than the clock resolution
         if (EXPORT_TO_CSV) {
+            std::chrono::steady_clock::time_point startQueries = std::chrono::steady_clock::now();
+            long checksum = 0;
+            for (int i = 0; i < seq.size(); i++)
+            {
+                for (int j = 0; j < seq.size(); j++)
+                {
+                    checksum += rmq.rangeMin(i, j);
+                }
+            }
+            double averageQueryTime = elapsedMicroseconds(startQueries) / (seq.size() * seq.size());
             queryFile << sequenceLength << "," << averageQueryTime << "\n";
+            querySink = checksum;
         }
 
         total += correct + wrong;
@@ -107,7 +200,8 @@ void testRMQ()
         queryFile.close();
     }
 
-    std::cout << "\n\t******* Total correct queries: " << totalCorrect << "/" << total << "\n\n";
+    std::cout << "\n\t******* Total correct queries: " << totalCorrect << "/" << total << "\n";
+    std::cout << "\t******* Total correct argmax queries: " << totalArgMaxCorrect << "/" << total << "\n\n";
 }
 
 // Generates next-node-on-path test samples for the given tree using Depth First Search 
@@ -144,6 +238,30 @@ void dfsNextNodeOnPathSamples(int root,
     path.pop_back();
 }
 
+// Corrupts section s of a snapshot file: its first 4 bytes become value or, if shrink is set, its
+// element count drops by one, with the header checksum recomputed so that only the lengths are off
+static void corruptSnapshot(const char *path, int s, bool shrink, uint32_t value = 0)
+{
+    std::ifstream in(path, std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    SnapshotHeader *header = (SnapshotHeader *)&bytes[0];
+    SnapshotSection *sections = (SnapshotSection *)&bytes[sizeof(SnapshotHeader)];
+    if (shrink)
+    {
+        sections[s].count--;
+        header->checksum = 0;
+        header->checksum = snapshotChecksum(sections, header->sectionCount * sizeof(SnapshotSection),
+                                            snapshotChecksum(header, sizeof(SnapshotHeader)));
+    }
+    else
+    {
+        std::memcpy(&bytes[sections[s].offset], &value, sizeof(value));
+    }
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << bytes;
+}
+
 void testNextNodeOnPath()
 {
     std::cout << "+++ Testing the NextNodeOnPath data structure against random n-ary trees of size up to " << MAX_NNOP_TEST_TREE_SIZE << " +++\n";
@@ -159,7 +277,10 @@ void testNextNodeOnPath()
         queryFile << "TreeSize,Time\n";
     }
 
-    int totalCorrect = 0, total = 0;
+    int totalCorrect = 0, total = 0, totalBatchCorrect = 0;
+    int totalSnapshotCorrect = 0, snapshotTotal = 0, corruptRejected = 0, corruptTotal = 0;
+    int copyOnWriteCorrect = 0, copyOnWriteTotal = 0;
+    int totalPathCorrect = 0, pathTotal = 0;
     std::vector<int> nodeVals, parent;
     std::vector<std::vector<int>> children;
     int root = 0;
@@ -194,10 +315,9 @@ void testNextNodeOnPath()
         }
 
         // preprocess tree for next-node-on-path queries
-        clock_t startPreprocess = clock();
+        std::chrono::steady_clock::time_point startPreprocess = std::chrono::steady_clock::now();
         NextNodeOnPath nextNodeOnPath(nodeVals, parent, children, root);
-        clock_t endPreprocess = clock();
-        double preprocessTime = 1000000.0 * (double)(endPreprocess - startPreprocess) / (double)CLOCKS_PER_SEC; // microseconds
+        double preprocessTime = elapsedMicroseconds(startPreprocess);
 
         if (EXPORT_TO_CSV) {
             preprocessFile << treeSize << "," << preprocessTime << "\n";
@@ -205,18 +325,11 @@ void testNextNodeOnPath()
 
         // test queries
         int correct = 0, wrong = 0;
-        double totalQueryTime = 0;
-        int queryCount = 0;
         for (std::vector<int> &sample : testSamples)
         {
             int x = sample[0], next = sample[1], y = sample[2];
 
-            clock_t startQuery = clock();
             int computedNext = nextNodeOnPath.query(x, y);
-            clock_t endQuery = clock();
-            double queryTime = ((double)(endQuery - startQuery) / (double)CLOCKS_PER_SEC) * 1000000; // microseconds
-            totalQueryTime += queryTime;
-            queryCount++;
 
             if (computedNext == next)
             {
@@ -228,9 +341,112 @@ void testNextNodeOnPath()
             }
         }
 
-        double averageQueryTime = totalQueryTime / queryCount;
+        // time all the queries in a separate pass: a single query is shorter than the clock resolution
         if (EXPORT_TO_CSV) {
+            std::chrono::steady_clock::time_point startQueries = std::chrono::steady_clock::now();
+            long checksum = 0;
+            for (std::vector<int> &sample : testSamples)
+            {
+                checksum += nextNodeOnPath.query(sample[0], sample[2]);
+            }
+            double averageQueryTime = elapsedMicroseconds(startQueries) / testSamples.size();
             queryFile << treeSize << "," << averageQueryTime << "\n";
+            querySink = checksum;
+        }
+
+        // test the same queries as a single batch
+        std::vector<int> sources(testSamples.size()), destinations(testSamples.size()), results(testSamples.size());
+        for (int k = 0; k < testSamples.size(); k++)
+        {
+            sources[k] = testSamples[k][0];
+            destinations[k] = testSamples[k][2];
+        }
+        nextNodeOnPath.queryBatch(sources.data(), destinations.data(), results.data(), testSamples.size());
+        for (int k = 0; k < testSamples.size(); k++)
+        {
+            if (results[k] == testSamples[k][1])
+            {
+                totalBatchCorrect++;
+            }
+        }
+
+        // test whole paths: walk each sample path with query, and compare every step with kthNodeOnPath
+        if (treeSize % 50 == 0)
+        {
+            for (std::vector<int> &sample : testSamples)
+            {
+                int x = sample[0], y = sample[2];
+                bool pathCorrect = true;
+                int node = x, steps = 0;
+                while (node != y)
+                {
+                    node = nextNodeOnPath.query(node, y);
+                    steps++;
+                    pathCorrect = pathCorrect && nextNodeOnPath.kthNodeOnPath(x, y, steps) == node;
+                }
+                pathCorrect = pathCorrect && nextNodeOnPath.distance(x, y) == steps;
+                if (pathCorrect)
+                {
+                    totalPathCorrect++;
+                }
+            }
+            pathTotal += testSamples.size();
+        }
+
+        // test the same queries on a copy saved to and loaded from a snapshot file
+        if (treeSize % 50 == 0)
+        {
+            nextNodeOnPath.save(SNAPSHOT_TEST_FILE);
+            NextNodeOnPath loaded = NextNodeOnPath::load(SNAPSHOT_TEST_FILE, true);
+            for (std::vector<int> &sample : testSamples)
+            {
+                if (loaded.query(sample[0], sample[2]) == sample[1])
+                {
+                    totalSnapshotCorrect++;
+                }
+            }
+            snapshotTotal += testSamples.size();
+
+            // corrupt snapshots are rejected on load, without verifying the checksums: sections 0,
+            // 1 and 6 hold the node order, the parent array and the LCA block bits, and section 8
+            // the Euler Tour
+            const int corruptSections[] = {0, 6, 1, 8};
+            for (int c = 0; c < 4; c++)
+            {
+                nextNodeOnPath.save(SNAPSHOT_TEST_FILE);
+                corruptSnapshot(SNAPSHOT_TEST_FILE, corruptSections[c], c >= 2, c == 0 ? 7 : LCA_MAX_BLOCK_BITS + 1);
+                try
+                {
+                    NextNodeOnPath::load(SNAPSHOT_TEST_FILE);
+                }
+                catch (const std::runtime_error &)
+                {
+                    corruptRejected++;
+                }
+                corruptTotal++;
+            }
+
+            // an array borrowed from the read-only mapping is copied when written through, and
+            // the file keeps its contents
+            {
+                SnapshotWriter writer(SNAPSHOT_NEXT_NODE_ON_PATH);
+                Array<int> values(sources);
+                writer.write(values);
+                writer.save(SNAPSHOT_TEST_FILE);
+                SnapshotReader reader(SNAPSHOT_TEST_FILE, SNAPSHOT_NEXT_NODE_ON_PATH);
+                Array<int> borrowed;
+                reader.read(borrowed);
+                borrowed[0] = -1;
+                SnapshotReader rereader(SNAPSHOT_TEST_FILE, SNAPSHOT_NEXT_NODE_ON_PATH);
+                Array<int> reread;
+                rereader.read(reread);
+                if (borrowed[0] == -1 && reread[0] == sources[0] && std::equal(sources.begin() + 1, sources.end(), borrowed.begin() + 1))
+                {
+                    copyOnWriteCorrect++;
+                }
+                copyOnWriteTotal++;
+            }
+            std::remove(SNAPSHOT_TEST_FILE);
         }
 
         total += correct + wrong;
@@ -242,5 +458,1060 @@ void testNextNodeOnPath()
         queryFile.close();
     }
 
-    std::cout << "\n\t******* Total correct queries: " << totalCorrect << "/" << total << "\n\n";
+    // a caterpillar a million nodes deep, which a recursive walk of the tree would overflow the
+    // stack on: a spine 0, 1, 2, ... with every other node a leaf of a random spine node
+    std::cout << "Deep caterpillar of size " << NNOP_TEST_DEEP_TREE_SIZE << "..." << std::endl;
+    int spine = NNOP_TEST_DEEP_TREE_SIZE / 2;
+    nodeVals.assign(NNOP_TEST_DEEP_TREE_SIZE, 0);
+    parent.resize(NNOP_TEST_DEEP_TREE_SIZE);
+    children.assign(NNOP_TEST_DEEP_TREE_SIZE, {});
+    parent[0] = -1;
+    for (int i = 1; i < NNOP_TEST_DEEP_TREE_SIZE; i++)
+    {
+        parent[i] = i < spine ? i - 1 : std::rand() % spine;
+        children[parent[i]].push_back(i);
+    }
+    const NextNodeOnPath deep(nodeVals, parent, children, 0);
+    std::vector<int> deepSrc(NNOP_TEST_DEEP_QUERIES), deepDst(NNOP_TEST_DEEP_QUERIES), deepExpected(NNOP_TEST_DEEP_QUERIES);
+    for (int q = 0; q < NNOP_TEST_DEEP_QUERIES; q++)
+    {
+        int i = std::rand() % NNOP_TEST_DEEP_TREE_SIZE, j = std::rand() % NNOP_TEST_DEEP_TREE_SIZE;
+        int jSpine = j < spine ? j : parent[j]; // the spine node j hangs off
+        deepSrc[q] = i;
+        deepDst[q] = j;
+        if (i == j)
+            deepExpected[q] = -1;
+        else if (i >= spine) // a leaf only has its parent
+            deepExpected[q] = parent[i];
+        else if (jSpine == i) // down to a leaf of i
+            deepExpected[q] = j;
+        else
+            deepExpected[q] = jSpine > i ? i + 1 : i - 1;
+    }
+    std::vector<int> deepResults(NNOP_TEST_DEEP_QUERIES);
+    deep.queryBatch(deepSrc.data(), deepDst.data(), deepResults.data(), NNOP_TEST_DEEP_QUERIES);
+    int deepCorrect = 0;
+    for (int q = 0; q < NNOP_TEST_DEEP_QUERIES; q++)
+    {
+        if (deep.query(deepSrc[q], deepDst[q]) == deepExpected[q] && deepResults[q] == deepExpected[q])
+        {
+            deepCorrect++;
+        }
+    }
+
+    std::cout << "\n\t******* Total correct queries: " << totalCorrect << "/" << total << "\n";
+    std::cout << "\t******* Total correct batched queries: " << totalBatchCorrect << "/" << total << "\n";
+    std::cout << "\t******* Total correct k-th node paths: " << totalPathCorrect << "/" << pathTotal << "\n";
+    std::cout << "\t******* Total correct queries after snapshot reload: " << totalSnapshotCorrect << "/" << snapshotTotal << "\n";
+    std::cout << "\t******* Total rejected corrupt snapshots: " << corruptRejected << "/" << corruptTotal << "\n";
+    std::cout << "\t******* Total snapshot arrays copied on write: " << copyOnWriteCorrect << "/" << copyOnWriteTotal << "\n";
+    std::cout << "\t******* Total correct queries on a deep caterpillar: " << deepCorrect << "/" << NNOP_TEST_DEEP_QUERIES << "\n\n";
+}
+
+void testConcurrentQueries()
+{
+    std::cout << "+++ Testing concurrent queries on one shared NextNodeOnPath from " << CONCURRENT_TEST_THREADS << " threads +++\n";
+    srand(time(0));
+
+    // generate random n-ary tree
+    int treeSize = CONCURRENT_TEST_TREE_SIZE, root = 0;
+    std::vector<int> nodeVals(treeSize), parent(treeSize);
+    std::vector<std::vector<int>> children(treeSize);
+    parent[root] = -1;
+    for (int i = 1; i < treeSize; i++)
+    {
+        nodeVals[i] = std::rand() % 201 - 100;
+        parent[i] = std::rand() % i;
+        children[parent[i]].push_back(i);
+    }
+
+    // generate test samples with Depth First Search from every node
+    std::vector<std::vector<int>> testSamples; // contains tuples (source, next, destination)
+    for (int node = 0; node < treeSize; node++)
+    {
+        std::list<int> path;
+        std::vector<bool> visited(treeSize, false);
+        dfsNextNodeOnPathSamples(node, parent, children, path, visited, testSamples);
+    }
+
+    const NextNodeOnPath nextNodeOnPath(nodeVals, parent, children, root);
+
+    // every thread checks all the samples, starting from a different offset
+    std::atomic<long> correct(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < CONCURRENT_TEST_THREADS; t++)
+    {
+        threads.push_back(std::thread([&, t]()
+        {
+            long threadCorrect = 0;
+            size_t offset = testSamples.size() * t / CONCURRENT_TEST_THREADS;
+            for (size_t k = 0; k < testSamples.size(); k++)
+            {
+                const std::vector<int> &sample = testSamples[(offset + k) % testSamples.size()];
+                if (nextNodeOnPath.query(sample[0], sample[2]) == sample[1])
+                {
+                    threadCorrect++;
+                }
+            }
+            correct += threadCorrect;
+        }));
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+
+    std::cout << "\n\t******* Total correct concurrent queries: " << correct << "/" << (long)testSamples.size() * CONCURRENT_TEST_THREADS << "\n\n";
+}
+
+// Finds the next node on the path from i to j by walking up the parent links (-1 if i == j)
+static int naiveNextNodeOnPath(const std::vector<int> &parent, int i, int j)
+{
+    if (i == j)
+        return -1;
+    for (int v = j; v != -1; v = parent[v])
+    {
+        if (parent[v] == i) // i is a proper ancestor of j
+            return v;
+    }
+    return parent[i];
+}
+
+// Shapes of the random test trees
+enum TestTreeShape
+{
+    TEST_TREE_RANDOM,      // parent of each node uniform among the nodes before it, in shuffled order
+    TEST_TREE_CATERPILLAR, // parent of each node among the last three before it, so the tree is deep
+    TEST_TREE_STAR         // every node a child of the root
+};
+
+// Generates a random tree of the given shape as a parent array, with shuffled ids, rooted anywhere
+static std::vector<int> randomTree(int size, TestTreeShape shape)
+{
+    std::vector<int> order(size);
+    for (int i = 0; i < size; i++)
+    {
+        order[i] = i;
+    }
+    std::random_shuffle(order.begin(), order.end());
+    std::vector<int> parent(size, -1);
+    for (int i = 1; i < size; i++)
+    {
+        int p = shape == TEST_TREE_CATERPILLAR ? i - 1 - std::rand() % std::min(i, 3) : shape == TEST_TREE_STAR ? 0 : std::rand() % i;
+        parent[order[i]] = order[p];
+    }
+    return parent;
+}
+
+void testDynamicTree()
+{
+    std::cout << "+++ Testing the DynamicTree data structure against " << DYNAMIC_TEST_UPDATES << " random leaf insertions and re-parentings +++\n";
+    srand(time(0));
+
+    // start from a small random tree
+    std::vector<int> parent = {-1};
+    for (int i = 1; i < 20; i++)
+    {
+        parent.push_back(std::rand() % i);
+    }
+    CSRTree initialTree(parent);
+    DynamicTree dynamicTree(initialTree.view());
+
+    int correct = 0, total = 0;
+    for (int update = 0; update < DYNAMIC_TEST_UPDATES; update++)
+    {
+        if (std::rand() % 2 == 0) // add a leaf
+        {
+            int p = std::rand() % parent.size();
+            dynamicTree.addLeaf(p);
+            parent.push_back(p);
+        }
+        else // re-parent a random subtree under a node outside of it
+        {
+            int v = 1 + std::rand() % (parent.size() - 1); // never the root
+            int p = std::rand() % parent.size();
+            bool inSubtree = false;
+            for (int u = p; u != -1; u = parent[u])
+                inSubtree = inSubtree || u == v;
+            if (!inSubtree)
+            {
+                dynamicTree.cut(v);
+                dynamicTree.link(v, p);
+                parent[v] = p;
+            }
+        }
+
+        for (int q = 0; q < DYNAMIC_TEST_QUERIES_PER_UPDATE; q++)
+        {
+            int i = std::rand() % parent.size(), j = std::rand() % parent.size();
+            if (dynamicTree.query(i, j) == naiveNextNodeOnPath(parent, i, j))
+            {
+                correct++;
+            }
+            total++;
+        }
+    }
+
+    std::cout << "\n\t******* Total correct dynamic tree queries: " << correct << "/" << total << "\n\n";
+}
+
+void testIncrementalNextNodeOnPath()
+{
+    std::cout << "+++ Testing the IncrementalNextNodeOnPath data structure against " << INCREMENTAL_TEST_LEAVES << " appended leaves, with "
+              << INCREMENTAL_TEST_READERS << " concurrent reader threads +++\n";
+    srand(time(0));
+
+    // the whole tree is generated up front: a random initial tree, then leaves added mostly
+    // under recent nodes, so that the overlay also holds deep paths
+    int initialSize = 100, treeSize = initialSize + INCREMENTAL_TEST_LEAVES;
+    std::vector<int> parent(treeSize, -1);
+    for (int i = 1; i < treeSize; i++)
+    {
+        parent[i] = std::rand() % 4 == 0 ? std::rand() % i : i - 1 - std::rand() % std::min(i, 8);
+    }
+    std::vector<int> initialParent(parent.begin(), parent.begin() + initialSize);
+    CSRTree initialTree(initialParent);
+    IncrementalNextNodeOnPath nextNodeOnPath(initialTree.view(), INCREMENTAL_TEST_REBUILD_THRESHOLD);
+
+    // readers query the nodes added so far while the leaves are appended and the structure rebuilt
+    std::atomic<bool> done(false);
+    std::atomic<long> correct(0), total(0);
+    std::vector<std::thread> readers;
+    for (int t = 0; t < INCREMENTAL_TEST_READERS; t++)
+    {
+        readers.push_back(std::thread([&, t]()
+        {
+            std::mt19937 rng(t);
+            long readerCorrect = 0, readerTotal = 0;
+            while (!done)
+            {
+                int n = nextNodeOnPath.size();
+                int i = rng() % n, j = rng() % n;
+                if (nextNodeOnPath.query(i, j) == naiveNextNodeOnPath(parent, i, j))
+                {
+                    readerCorrect++;
+                }
+                readerTotal++;
+            }
+            correct += readerCorrect;
+            total += readerTotal;
+        }));
+    }
+
+    for (int v = initialSize; v < treeSize; v++)
+    {
+        nextNodeOnPath.addLeaf(parent[v]);
+        for (int q = 0; q < DYNAMIC_TEST_QUERIES_PER_UPDATE; q++)
+        {
+            int i = std::rand() % (v + 1), j = std::rand() % (v + 1);
+            if (nextNodeOnPath.query(i, j) == naiveNextNodeOnPath(parent, i, j))
+            {
+                correct++;
+            }
+            total++;
+        }
+    }
+    done = true;
+    for (std::thread &reader : readers)
+    {
+        reader.join();
+    }
+
+    // after the last rebuild, the overlay only holds the leaves appended while it was running
+    nextNodeOnPath.waitForRebuild();
+    for (int q = 0; q < treeSize; q++)
+    {
+        int i = std::rand() % treeSize, j = std::rand() % treeSize;
+        if (nextNodeOnPath.query(i, j) == naiveNextNodeOnPath(parent, i, j))
+        {
+            correct++;
+        }
+        total++;
+    }
+
+    std::cout << "\n\t******* Total correct incremental queries: " << correct << "/" << total << "\n\n";
+}
+
+void testForest()
+{
+    std::cout << "+++ Testing the Forest data structure against " << FOREST_TEST_TREES << " random trees of size up to " << MAX_FOREST_TEST_TREE_SIZE << " +++\n";
+    srand(time(0));
+
+    // generate random trees, rooted anywhere
+    std::vector<std::vector<int>> parents(FOREST_TEST_TREES);
+    std::vector<CSRTree> csrTrees;
+    std::vector<TreeView> trees;
+    csrTrees.reserve(FOREST_TEST_TREES);
+    for (std::vector<int> &parent : parents)
+    {
+        parent = randomTree(1 + std::rand() % MAX_FOREST_TEST_TREE_SIZE, TEST_TREE_RANDOM);
+        csrTrees.push_back(CSRTree(parent));
+        trees.push_back(csrTrees.back().view());
+    }
+    const Forest forest(trees);
+
+    // every pair of nodes within each tree, by tree-local and global ids
+    int correct = 0, total = 0;
+    std::vector<int> src, dst, expected;
+    for (int t = 0; t < FOREST_TEST_TREES; t++)
+    {
+        const std::vector<int> &parent = parents[t];
+        for (int i = 0; i < parent.size(); i++)
+        {
+            for (int j = 0; j < parent.size(); j++)
+            {
+                int next = naiveNextNodeOnPath(parent, i, j);
+                int globalNext = next == -1 ? -1 : forest.globalId(t, next);
+                if (forest.query(t, i, j) == next && forest.query(forest.globalId(t, i), forest.globalId(t, j)) == globalNext)
+                {
+                    correct++;
+                }
+                total++;
+                src.push_back(forest.globalId(t, i));
+                dst.push_back(forest.globalId(t, j));
+                expected.push_back(globalNext);
+            }
+        }
+    }
+
+    // random pairs of global ids, mostly across trees
+    int pairsWithinTrees = total;
+    for (int q = 0; q < pairsWithinTrees; q++)
+    {
+        int i = std::rand() % forest.size(), j = std::rand() % forest.size();
+        int t = forest.treeOf(i);
+        int next = -1;
+        if (forest.treeOf(j) == t)
+        {
+            next = naiveNextNodeOnPath(parents[t], i - forest.globalId(t, 0), j - forest.globalId(t, 0));
+            next = next == -1 ? -1 : forest.globalId(t, next);
+        }
+        if (forest.query(i, j) == next)
+        {
+            correct++;
+        }
+        total++;
+        src.push_back(i);
+        dst.push_back(j);
+        expected.push_back(next);
+    }
+
+    int batchCorrect = 0;
+    std::vector<int> out(src.size());
+    forest.queryBatch(src.data(), dst.data(), out.data(), src.size());
+    for (size_t q = 0; q < out.size(); q++)
+    {
+        if (out[q] == expected[q])
+        {
+            batchCorrect++;
+        }
+    }
+
+    std::cout << "\n\t******* Total correct forest queries: " << correct << "/" << total << "\n";
+    std::cout << "\t******* Total correct batched forest queries: " << batchCorrect << "/" << total << "\n\n";
+}
+
+void testNodeRelabeling()
+{
+    std::cout << "+++ Testing pre-order relabeling against " << RELABEL_TEST_TREES << " random trees of size up to " << MAX_RELABEL_TEST_TREE_SIZE << " +++\n";
+    srand(time(0));
+
+    int correct = 0, pathCorrect = 0, batchCorrect = 0, snapshotCorrect = 0, total = 0, pathTotal = 0;
+    for (int t = 0; t < RELABEL_TEST_TREES; t++)
+    {
+        int treeSize = 1 + std::rand() % MAX_RELABEL_TEST_TREE_SIZE;
+        std::vector<int> parent = randomTree(treeSize, TEST_TREE_RANDOM);
+        CSRTree tree(parent);
+        const NextNodeOnPath plain(tree.view());
+        const NextNodeOnPath relabeled(tree.view(), 0, NODE_ORDER_PRE_ORDER);
+        relabeled.save(SNAPSHOT_TEST_FILE);
+        const NextNodeOnPath loaded = NextNodeOnPath::load(SNAPSHOT_TEST_FILE, true);
+        std::remove(SNAPSHOT_TEST_FILE);
+
+        // every pair of nodes, and every node on their path
+        std::vector<int> src, dst, expected;
+        for (int i = 0; i < treeSize; i++)
+        {
+            for (int j = 0; j < treeSize; j++)
+            {
+                src.push_back(i);
+                dst.push_back(j);
+                expected.push_back(naiveNextNodeOnPath(parent, i, j));
+
+                // a node to itself gives -1, in both orders
+                if (relabeled.query(i, j) == expected.back() && (i != j || plain.query(i, j) == -1))
+                {
+                    correct++;
+                }
+                if (loaded.query(i, j) == expected.back())
+                {
+                    snapshotCorrect++;
+                }
+                total++;
+                if (i == j)
+                {
+                    continue;
+                }
+
+                int length = plain.distance(i, j);
+                bool pathMatches = relabeled.distance(i, j) == length;
+                for (int k = 0; k <= length; k++)
+                {
+                    pathMatches = pathMatches && relabeled.kthNodeOnPath(i, j, k) == plain.kthNodeOnPath(i, j, k);
+                }
+                if (pathMatches)
+                {
+                    pathCorrect++;
+                }
+                pathTotal++;
+            }
+        }
+
+        std::vector<int> out(src.size());
+        relabeled.queryBatch(src.data(), dst.data(), out.data(), src.size());
+        for (size_t q = 0; q < out.size(); q++)
+        {
+            if (out[q] == expected[q])
+            {
+                batchCorrect++;
+            }
+        }
+    }
+
+    std::cout << "\n\t******* Total correct relabeled queries: " << correct << "/" << total << "\n";
+    std::cout << "\t******* Total correct relabeled batched queries: " << batchCorrect << "/" << total << "\n";
+    std::cout << "\t******* Total correct relabeled k-th node paths: " << pathCorrect << "/" << pathTotal << "\n";
+    std::cout << "\t******* Total correct relabeled queries after snapshot reload: " << snapshotCorrect << "/" << total << "\n\n";
+}
+
+void testArrayMemory()
+{
+    std::cout << "+++ Testing NextNodeOnPath with its arrays in each kind of array memory, on a random tree of size " << MEMORY_TEST_TREE_SIZE << " +++\n";
+    srand(time(0));
+
+    std::vector<int> parent(MEMORY_TEST_TREE_SIZE, -1);
+    for (int v = 1; v < MEMORY_TEST_TREE_SIZE; v++)
+    {
+        parent[v] = std::rand() % v;
+    }
+    CSRTree tree(parent);
+    const NextNodeOnPath reference(tree.view());
+    std::vector<int> src(MEMORY_TEST_QUERIES), dst(MEMORY_TEST_QUERIES), expected(MEMORY_TEST_QUERIES);
+    for (int q = 0; q < MEMORY_TEST_QUERIES; q++)
+    {
+        do
+        {
+            src[q] = std::rand() % MEMORY_TEST_TREE_SIZE;
+            dst[q] = std::rand() % MEMORY_TEST_TREE_SIZE;
+        } while (src[q] == dst[q]);
+        expected[q] = reference.query(src[q], dst[q]);
+    }
+    auto countCorrect = [&](const NextNodeOnPath &nextNodeOnPath)
+    {
+        int correct = 0;
+        for (int q = 0; q < MEMORY_TEST_QUERIES; q++)
+        {
+            if (nextNodeOnPath.query(src[q], dst[q]) == expected[q])
+            {
+                correct++;
+            }
+        }
+        return correct;
+    };
+
+    // every array allocated in the scope, also by the preprocessing threads, goes through the
+    // resource and is given back to it, while a structure built meanwhile on another thread
+    // allocates from the heap
+    long correct = 0, total = 0;
+    CountingMemory counting;
+    std::unique_ptr<NextNodeOnPath> elsewhere;
+    {
+        std::unique_ptr<NextNodeOnPath> built, copied;
+        {
+            ScopedArrayMemory scope(&counting);
+            std::thread other([&]() { elsewhere.reset(new NextNodeOnPath(tree.view())); });
+            built.reset(new NextNodeOnPath(tree.view(), 4));
+            copied.reset(new NextNodeOnPath(reference));
+            other.join();
+        }
+        bool allArrays = counting.allocated() >= 2 * sizeof(int) * 5 * MEMORY_TEST_TREE_SIZE;
+        correct += allArrays ? countCorrect(*built) + countCorrect(*copied) + countCorrect(*elsewhere) : 0;
+        total += 3 * MEMORY_TEST_QUERIES;
+    }
+    if (counting.outstanding() != 0)
+    {
+        correct = 0;
+    }
+    elsewhere.reset();
+
+    const PageSize pageSizes[] = {PAGES_SMALL, PAGES_TRANSPARENT, PAGES_HUGE_2MB, PAGES_HUGE_1GB};
+    const NumaPolicy policies[] = {NUMA_DEFAULT, NUMA_INTERLEAVE};
+    for (PageSize pages : pageSizes)
+    {
+        for (NumaPolicy numa : policies)
+        {
+            PageMemory memory(pages, numa);
+            ScopedArrayMemory scope(&memory);
+            correct += countCorrect(NextNodeOnPath(tree.view()));
+            total += MEMORY_TEST_QUERIES;
+        }
+    }
+
+    NumaReplicated<NextNodeOnPath> replicated(reference);
+    for (int node = 0; node < replicated.replicaCount(); node++)
+    {
+        correct += countCorrect(replicated.replica(node));
+        total += MEMORY_TEST_QUERIES;
+    }
+    correct += countCorrect(replicated.local());
+    total += MEMORY_TEST_QUERIES;
+
+    std::cout << "\n\t******* Total correct queries over custom array memory: " << correct << "/" << total << "\n\n";
+}
+
+void testSuccinctTree()
+{
+    std::cout << "+++ Testing the SuccinctTree data structure against " << SUCCINCT_TEST_TREES << " random trees of size up to " << MAX_SUCCINCT_TEST_TREE_SIZE << " and " << SUCCINCT_TEST_CHAINS << " chains of " << SUCCINCT_TEST_CHAIN_LENGTH << " nodes +++\n";
+    srand(time(0));
+
+    long correct = 0, total = 0;
+    for (int t = 0; t < SUCCINCT_TEST_TREES; t++)
+    {
+        // every fourth tree is a deep caterpillar
+        int treeSize = 1 + std::rand() % MAX_SUCCINCT_TEST_TREE_SIZE;
+        std::vector<int> parent = randomTree(treeSize, t % 4 == 1 ? TEST_TREE_CATERPILLAR : TEST_TREE_RANDOM);
+        CSRTree tree(parent);
+        std::vector<int> preOrder;
+        const SuccinctTree succinct(tree.view(), &preOrder);
+        const LCA lca(tree.view());
+
+        // succinct nodes are numbered in pre-order
+        std::vector<int> succinctId(treeSize);
+        for (int k = 0; k < treeSize; k++)
+        {
+            succinctId[preOrder[k]] = k;
+        }
+        auto toSuccinct = [&](int v) { return v == -1 ? -1 : succinctId[v]; };
+
+        for (int v = 0; v < treeSize; v++)
+        {
+            if (succinct.parent(succinctId[v]) == toSuccinct(parent[v]) && succinct.depth(succinctId[v]) == lca.depth(v))
+            {
+                correct++;
+            }
+            total++;
+        }
+        for (int q = 0; q < SUCCINCT_TEST_PAIRS; q++)
+        {
+            int i = std::rand() % treeSize, j = std::rand() % treeSize;
+            if (succinct.lca(succinctId[i], succinctId[j]) == succinctId[lca.lca(i, j)] &&
+                succinct.query(succinctId[i], succinctId[j]) == toSuccinct(naiveNextNodeOnPath(parent, i, j)))
+            {
+                correct++;
+            }
+            total++;
+        }
+    }
+
+    // long chains under the root: the closed parentheses at the end of each chain span many
+    // blocks without a select sample, which select must cross in one search
+    int treeSize = 1 + SUCCINCT_TEST_CHAINS * SUCCINCT_TEST_CHAIN_LENGTH;
+    std::vector<int> parent(treeSize, -1);
+    for (int v = 1; v < treeSize; v++)
+    {
+        parent[v] = (v - 1) % SUCCINCT_TEST_CHAIN_LENGTH ? v - 1 : 0;
+    }
+    CSRTree tree(parent);
+    std::vector<int> preOrder;
+    const SuccinctTree succinct(tree.view(), &preOrder);
+    const NextNodeOnPath nextNodeOnPath(tree.view());
+    const LCA lca(tree.view());
+    std::vector<int> succinctId(treeSize);
+    for (int k = 0; k < treeSize; k++)
+    {
+        succinctId[preOrder[k]] = k;
+    }
+    auto toSuccinct = [&](int v) { return v == -1 ? -1 : succinctId[v]; };
+    for (int v = 0; v < treeSize; v++)
+    {
+        if (succinct.parent(succinctId[v]) == toSuccinct(parent[v]) && succinct.depth(succinctId[v]) == lca.depth(v))
+        {
+            correct++;
+        }
+        total++;
+    }
+    for (int q = 0; q < SUCCINCT_TEST_PAIRS; q++)
+    {
+        int i = std::rand() % treeSize, j = std::rand() % treeSize;
+        if (succinct.lca(succinctId[i], succinctId[j]) == succinctId[lca.lca(i, j)] &&
+            succinct.query(succinctId[i], succinctId[j]) == toSuccinct(nextNodeOnPath.query(i, j)))
+        {
+            correct++;
+        }
+        total++;
+    }
+
+    std::cout << "\n\t******* Total correct succinct tree queries: " << correct << "/" << total << "\n\n";
+}
+
+void testPathAggregate()
+{
+    std::cout << "+++ Testing the PathAggregate data structure against " << PATH_AGGREGATE_TEST_TREES << " random trees of size up to " << MAX_PATH_AGGREGATE_TEST_TREE_SIZE << " +++\n";
+    srand(time(0));
+
+    long correct = 0, total = 0;
+    for (int t = 0; t < PATH_AGGREGATE_TEST_TREES; t++)
+    {
+        // every fourth tree is a deep caterpillar
+        int treeSize = 1 + std::rand() % MAX_PATH_AGGREGATE_TEST_TREE_SIZE;
+        std::vector<int> parent = randomTree(treeSize, t % 4 == 1 ? TEST_TREE_CATERPILLAR : TEST_TREE_RANDOM);
+        std::vector<long long> weights(treeSize);
+        for (long long &w : weights)
+        {
+            w = std::rand() % 2001 - 1000;
+        }
+        CSRTree tree(parent);
+        const PathAggregate<long long, PathMin<long long>> pathMin(tree.view(), weights);
+        const PathAggregate<long long, PathMax<long long>> pathMax(tree.view(), weights);
+        const PathAggregate<long long> pathSum(tree.view(), weights);
+        const LCA lca(tree.view());
+        std::vector<int> depth(treeSize);
+        for (int v = 0; v < treeSize; v++)
+        {
+            depth[v] = lca.depth(v);
+        }
+
+        for (int q = 0; q < PATH_AGGREGATE_TEST_PAIRS; q++)
+        {
+            // climb from both ends, the deeper one first, until they meet
+            int i = std::rand() % treeSize, j = std::rand() % treeSize;
+            long long minWeight = weights[i], maxWeight = weights[i], sumWeight = weights[i];
+            auto add = [&](int v)
+            {
+                minWeight = std::min(minWeight, weights[v]);
+                maxWeight = std::max(maxWeight, weights[v]);
+                sumWeight += weights[v];
+            };
+            int u = i, v = j, uDepth = depth[i], vDepth = depth[j];
+            if (u != v)
+            {
+                add(v);
+            }
+            while (u != v)
+            {
+                if (uDepth >= vDepth)
+                {
+                    u = parent[u];
+                    uDepth--;
+                    if (u != v)
+                    {
+                        add(u);
+                    }
+                }
+                else
+                {
+                    v = parent[v];
+                    vDepth--;
+                    if (u != v)
+                    {
+                        add(v);
+                    }
+                }
+            }
+            if (pathMin.query(i, j) == minWeight && pathMax.query(i, j) == maxWeight && pathSum.query(i, j) == sumWeight)
+            {
+                correct++;
+            }
+            total++;
+        }
+    }
+
+    std::cout << "\n\t******* Total correct path aggregates: " << correct << "/" << total << "\n\n";
+}
+
+void testEulerNextNodeOnPath()
+{
+    std::cout << "+++ Testing the EulerNextNodeOnPath engine against NextNodeOnPath on " << EULER_TEST_TREES << " random trees of size up to " << MAX_EULER_TEST_TREE_SIZE << " +++\n";
+    srand(time(0));
+
+    long correct = 0, total = 0;
+    for (int t = 0; t < EULER_TEST_TREES; t++)
+    {
+        // every fourth tree is a deep caterpillar and every fourth a star, so that searches cross
+        // many blocks or none
+        int treeSize = 1 + std::rand() % MAX_EULER_TEST_TREE_SIZE;
+        std::vector<int> parent = randomTree(treeSize, t % 4 == 1 ? TEST_TREE_CATERPILLAR : t % 4 == 2 ? TEST_TREE_STAR : TEST_TREE_RANDOM);
+        CSRTree tree(parent);
+        const EulerNextNodeOnPath engine(tree.view());
+        const NextNodeOnPath nextNodeOnPath(tree.view());
+
+        std::vector<int> src(EULER_TEST_PAIRS), dst(EULER_TEST_PAIRS), expected(EULER_TEST_PAIRS), out(EULER_TEST_PAIRS);
+        for (int q = 0; q < EULER_TEST_PAIRS; q++)
+        {
+            // half of the pairs start from an ancestor of the destination (or the destination itself)
+            dst[q] = std::rand() % treeSize;
+            src[q] = q % 2 ? std::rand() % treeSize : dst[q];
+            for (int up = q % 2 ? 0 : std::rand() % 64; up > 0 && parent[src[q]] != -1; up--)
+            {
+                src[q] = parent[src[q]];
+            }
+        }
+        nextNodeOnPath.queryBatch(src.data(), dst.data(), expected.data(), EULER_TEST_PAIRS);
+        engine.queryBatch(src.data(), dst.data(), out.data(), EULER_TEST_PAIRS);
+        for (int q = 0; q < EULER_TEST_PAIRS; q++)
+        {
+            if (engine.query(src[q], dst[q]) == expected[q] && out[q] == expected[q])
+            {
+                correct++;
+            }
+            total++;
+        }
+    }
+
+    std::cout << "\n\t******* Total correct Euler Tour engine queries: " << correct << "/" << total << "\n\n";
+}
+
+void testOfflineQueries()
+{
+    std::cout << "+++ Testing offline LCA and next-node-on-path queries on " << OFFLINE_TEST_TREES << " random trees of size up to " << MAX_OFFLINE_TEST_TREE_SIZE << " +++\n";
+    srand(time(0));
+
+    long correctLCA = 0, correctNext = 0, total = 0;
+    for (int t = 0; t < OFFLINE_TEST_TREES; t++)
+    {
+        // every fourth tree is a deep caterpillar
+        int treeSize = 1 + std::rand() % MAX_OFFLINE_TEST_TREE_SIZE;
+        std::vector<int> parent = randomTree(treeSize, t % 4 == 1 ? TEST_TREE_CATERPILLAR : TEST_TREE_RANDOM);
+        CSRTree tree(parent);
+        const LCA lca(tree.view());
+        const NextNodeOnPath nextNodeOnPath(tree.view());
+
+        // a quarter of the pairs start from an ancestor of the destination (or the destination itself)
+        std::vector<int> src(OFFLINE_TEST_PAIRS), dst(OFFLINE_TEST_PAIRS), expected(OFFLINE_TEST_PAIRS);
+        for (int q = 0; q < OFFLINE_TEST_PAIRS; q++)
+        {
+            dst[q] = std::rand() % treeSize;
+            src[q] = q % 4 ? std::rand() % treeSize : dst[q];
+            for (int up = q % 4 ? 0 : std::rand() % 64; up > 0 && parent[src[q]] != -1; up--)
+            {
+                src[q] = parent[src[q]];
+            }
+        }
+        nextNodeOnPath.queryBatch(src.data(), dst.data(), expected.data(), OFFLINE_TEST_PAIRS);
+
+        // alternately on one thread and on several
+        int threads = t % 2 ? OFFLINE_TEST_THREADS : 1;
+        std::vector<int> lcas(OFFLINE_TEST_PAIRS), next(OFFLINE_TEST_PAIRS);
+        offlineLCA(tree.view(), src.data(), dst.data(), lcas.data(), OFFLINE_TEST_PAIRS, threads);
+        offlineNextNodeOnPath(tree.view(), src.data(), dst.data(), next.data(), OFFLINE_TEST_PAIRS, threads);
+        for (int q = 0; q < OFFLINE_TEST_PAIRS; q++)
+        {
+            if (lcas[q] == lca.lca(src[q], dst[q]))
+            {
+                correctLCA++;
+            }
+            if (next[q] == expected[q])
+            {
+                correctNext++;
+            }
+            total++;
+        }
+    }
+
+    std::cout << "\n\t******* Total correct offline LCA queries: " << correctLCA << "/" << total << "\n";
+    std::cout << "\t******* Total correct offline next-node queries: " << correctNext << "/" << total << "\n\n";
+}
+
+void testQueryCache()
+{
+    std::cout << "+++ Testing cached LCA and next-node-on-path queries on " << CACHE_TEST_TREES << " random trees of size up to " << MAX_CACHE_TEST_TREE_SIZE << " +++\n";
+    srand(time(0));
+
+    long correct = 0, total = 0, correctConcurrent = 0, totalConcurrent = 0;
+    int consistentCounters = 0, caches = 0, rejected = 0;
+    for (int t = 0; t < CACHE_TEST_TREES; t++)
+    {
+        int treeSize = 2 + std::rand() % (MAX_CACHE_TEST_TREE_SIZE - 1);
+        std::vector<int> parent(treeSize, -1);
+        for (int i = 1; i < treeSize; i++)
+        {
+            parent[i] = std::rand() % i;
+        }
+        CSRTree tree(parent);
+        const LCA lca(tree.view());
+        const NextNodeOnPath nextNodeOnPath(tree.view());
+
+        // three quarters of the queries repeat a few hot pairs; caches of a few entries up to
+        // more than the hot pairs, so that entries get both hit and evicted. The endpoints are
+        // distinct, so that every cached answer is a node
+        std::vector<int> hotSrc(CACHE_TEST_HOT_PAIRS), hotDst(CACHE_TEST_HOT_PAIRS);
+        for (int h = 0; h < CACHE_TEST_HOT_PAIRS; h++)
+        {
+            hotSrc[h] = std::rand() % treeSize;
+            hotDst[h] = (hotSrc[h] + 1 + std::rand() % (treeSize - 1)) % treeSize;
+        }
+        std::vector<int> src(CACHE_TEST_QUERIES), dst(CACHE_TEST_QUERIES);
+        for (int q = 0; q < CACHE_TEST_QUERIES; q++)
+        {
+            int h = std::rand() % CACHE_TEST_HOT_PAIRS;
+            src[q] = q % 4 ? hotSrc[h] : std::rand() % treeSize;
+            dst[q] = q % 4 ? hotDst[h] : (src[q] + 1 + std::rand() % (treeSize - 1)) % treeSize;
+        }
+        size_t entries = 1 + std::rand() % (4 * CACHE_TEST_HOT_PAIRS);
+        CachedNextNodeOnPath cachedNextNodeOnPath(nextNodeOnPath, entries, true);
+        CachedLCA cachedLCA(lca, entries, true);
+        for (int q = 0; q < CACHE_TEST_QUERIES; q++)
+        {
+            if (cachedNextNodeOnPath.query(src[q], dst[q]) == nextNodeOnPath.query(src[q], dst[q]))
+            {
+                correct++;
+            }
+            if (cachedLCA.query(src[q], dst[q]) == lca.lca(src[q], dst[q]))
+            {
+                correct++;
+            }
+            total += 2;
+        }
+
+        // invalid pairs are rejected by the engine every time, and never cached
+        for (int attempt = 0; attempt < 2; attempt++)
+        {
+            try
+            {
+                cachedLCA.query(-1, -1);
+            }
+            catch (const std::out_of_range &)
+            {
+                rejected++;
+            }
+        }
+
+        // the same queries from several threads, through one shared cache
+        CachedNextNodeOnPath shared(nextNodeOnPath, entries, true);
+        std::atomic<long> threadsCorrect(0);
+        std::vector<std::thread> threads;
+        for (int k = 0; k < CACHE_TEST_THREADS; k++)
+        {
+            threads.push_back(std::thread([&, k]()
+            {
+                long threadCorrect = 0;
+                for (int q = k; q < CACHE_TEST_QUERIES; q += CACHE_TEST_THREADS / 2)
+                {
+                    if (shared.query(src[q], dst[q]) == nextNodeOnPath.query(src[q], dst[q]))
+                    {
+                        threadCorrect++;
+                    }
+                }
+                threadsCorrect += threadCorrect;
+            }));
+        }
+        for (std::thread &thread : threads)
+        {
+            thread.join();
+        }
+        correctConcurrent += threadsCorrect;
+        long sharedQueries = 0;
+        for (int k = 0; k < CACHE_TEST_THREADS; k++)
+        {
+            sharedQueries += (CACHE_TEST_QUERIES - k + CACHE_TEST_THREADS / 2 - 1) / (CACHE_TEST_THREADS / 2);
+        }
+        totalConcurrent += sharedQueries;
+
+        // the counters are exact, also when shared by several threads
+        const QueryCache &nextCache = cachedNextNodeOnPath.queryCache(), &lcaCache = cachedLCA.queryCache();
+        const QueryCache &sharedCache = shared.queryCache();
+        if (nextCache.capacity() >= entries && nextCache.hits() > 0 &&
+            nextCache.hits() + nextCache.misses() == CACHE_TEST_QUERIES)
+        {
+            consistentCounters++;
+        }
+        if (lcaCache.capacity() >= entries && lcaCache.hits() > 0 &&
+            lcaCache.hits() + lcaCache.misses() == CACHE_TEST_QUERIES + 2)
+        {
+            consistentCounters++;
+        }
+        if (sharedCache.hits() > 0 && sharedCache.hits() + sharedCache.misses() == sharedQueries)
+        {
+            consistentCounters++;
+        }
+        caches += 3;
+    }
+
+    std::cout << "\n\t******* Total correct cached queries: " << correct << "/" << total << "\n";
+    std::cout << "\t******* Total correct concurrent cached queries: " << correctConcurrent << "/" << totalConcurrent << "\n";
+    std::cout << "\t******* Total rejected invalid cached queries: " << rejected << "/" << 2 * CACHE_TEST_TREES << "\n";
+    std::cout << "\t******* Total caches with exact counters: " << consistentCounters << "/" << caches << "\n\n";
+}
+
+// Writes a tree file in the given format, with random separators in text files and, for edge
+// lists, the edges in random order and direction
+static void writeTreeFile(const std::vector<int> &parent, TreeFileFormat format, const char *path)
+{
+    const char *separators[] = {" ", "\n", "\t", "\r\n", "  \n "};
+    std::ofstream file(path, std::ios::binary);
+    std::vector<int> nodes(parent.size());
+    for (int v = 0; v < parent.size(); v++)
+    {
+        nodes[v] = v;
+    }
+    if (format == TREE_FILE_EDGES_BINARY || format == TREE_FILE_EDGES_TEXT)
+    {
+        std::random_shuffle(nodes.begin(), nodes.end());
+    }
+    for (int v : nodes)
+    {
+        int values[2] = {v, parent[v]};
+        if (std::rand() % 2)
+        {
+            std::swap(values[0], values[1]);
+        }
+        switch (format)
+        {
+        case TREE_FILE_PARENT_BINARY:
+            file.write((const char *)&parent[v], sizeof(int));
+            break;
+        case TREE_FILE_PARENT_TEXT:
+            file << parent[v] << separators[std::rand() % 5];
+            break;
+        case TREE_FILE_EDGES_BINARY:
+            if (parent[v] != -1)
+                file.write((const char *)values, sizeof(values));
+            break;
+        case TREE_FILE_EDGES_TEXT:
+            if (parent[v] != -1)
+                file << values[0] << separators[std::rand() % 5] << values[1] << separators[std::rand() % 5];
+            break;
+        }
+    }
+}
+
+// Writes the given text to a file
+static void writeTextFile(const std::string &text, const char *path)
+{
+    std::ofstream file(path, std::ios::binary);
+    file << text;
+}
+
+void testTreeLoader()
+{
+    std::cout << "+++ Testing the tree file loader on " << LOADER_TEST_TREES << " random trees of size up to " << MAX_LOADER_TEST_TREE_SIZE
+              << " and one of size " << LOADER_TEST_LARGE_TREE_SIZE << " +++\n";
+    srand(time(0));
+    const TreeFileFormat formats[] = {TREE_FILE_PARENT_BINARY, TREE_FILE_PARENT_TEXT, TREE_FILE_EDGES_BINARY, TREE_FILE_EDGES_TEXT};
+
+    int correct = 0, total = 0;
+    for (int t = 0; t <= LOADER_TEST_TREES; t++)
+    {
+        // the last tree spans several file blocks
+        int treeSize = t == LOADER_TEST_TREES ? LOADER_TEST_LARGE_TREE_SIZE : 1 + std::rand() % MAX_LOADER_TEST_TREE_SIZE;
+        std::vector<int> parent = randomTree(treeSize, TEST_TREE_RANDOM);
+        int root = std::find(parent.begin(), parent.end(), -1) - parent.begin();
+
+        for (TreeFileFormat format : formats)
+        {
+            writeTreeFile(parent, format, LOADER_TEST_FILE);
+            CSRTree tree = loadTree(LOADER_TEST_FILE, format, root);
+            TreeView view = tree.view();
+            if (view.size == treeSize && view.root == root && std::equal(parent.begin(), parent.end(), view.parent))
+            {
+                correct++;
+            }
+            total++;
+        }
+    }
+
+    // malformed files: a lone minus sign, a stray character, a truncated integer, two roots,
+    // an edge list with a cycle apart from the root, an odd number of edge endpoints, parent
+    // arrays with a cycle apart from the root, with a self-parent, and with two components
+    const char *malformedTexts[] = {"1 -1 - 0", "1 -1 x1", "", "-1 -1", "1 2\n2 3\n3 1\n", "0 1 1",
+                                    "-1 2 1 0", "-1 0 2", "-1 0 3 4 2 1"};
+    const TreeFileFormat malformedFormats[] = {TREE_FILE_PARENT_TEXT, TREE_FILE_PARENT_TEXT, TREE_FILE_PARENT_BINARY,
+                                               TREE_FILE_PARENT_TEXT, TREE_FILE_EDGES_TEXT, TREE_FILE_EDGES_TEXT,
+                                               TREE_FILE_PARENT_TEXT, TREE_FILE_PARENT_TEXT, TREE_FILE_PARENT_TEXT};
+    const int malformedFiles = sizeof(malformedFormats) / sizeof(malformedFormats[0]);
+    int rejected = 0;
+    for (int m = 0; m < malformedFiles; m++)
+    {
+        writeTextFile(m == 2 ? std::string("\xff\xff\xff\xff\x00", 5) : malformedTexts[m], LOADER_TEST_FILE);
+        try
+        {
+            loadTree(LOADER_TEST_FILE, malformedFormats[m]);
+        }
+        catch (const std::runtime_error &)
+        {
+            rejected++;
+        }
+    }
+    std::remove(LOADER_TEST_FILE);
+
+    std::cout << "\n\t******* Total correct loaded tree files: " << correct << "/" << total << "\n";
+    std::cout << "\t******* Total rejected malformed tree files: " << rejected << "/" << malformedFiles << "\n\n";
+}
+
+void testBlockKernels()
+{
+    SimdLevel widest = detectSimdLevel();
+    std::cout << "+++ Testing the vectorised preprocessing kernels up to " << simdLevelName(widest)
+              << " against the scalar ones, on random +/-1 sequences of length up to " << MAX_KERNEL_TEST_LENGTH << " +++\n";
+    srand(time(0));
+
+    long correct = 0, total = 0;
+    for (int length = 1; length <= MAX_KERNEL_TEST_LENGTH; length++)
+    {
+        // random inputs for all the kernels
+        std::vector<int> seq(length), index(length);
+        for (int i = 0; i < length; i++)
+        {
+            seq[i] = i == 0 ? 0 : seq[i - 1] + (std::rand() % 2 ? 1 : -1);
+            index[i] = std::rand();
+        }
+        int blockSize = 1 << std::rand() % (LCA_MAX_BLOCK_BITS + 1), blocks = length / blockSize;
+        const InBlockTables &tables = inBlockTables(blockSize);
+        std::vector<uint16_t> binaryStrings(blocks);
+        for (uint16_t &s : binaryStrings)
+        {
+            s = std::rand() % (1 << (blockSize - 1));
+        }
+        int half = 1 + std::rand() % length, windows = length - half;
+
+        // outputs of every kernel, as ints, for each instruction set
+        std::vector<std::vector<int>> outputs;
+        for (int level = SIMD_SCALAR; level <= widest; level++)
+        {
+            std::vector<uint64_t> steps((length + 63) / 64);
+            upStepBits(seq.data(), length, 0, steps.size(), steps.data(), (SimdLevel)level);
+            std::vector<int> output;
+            for (uint64_t word : steps)
+            {
+                output.push_back(word);
+                output.push_back(word >> 32);
+            }
+
+            std::vector<int> prefixMin(length, -1), suffixMin(length, -1), blockMin(blocks);
+            expandBlockMinima(binaryStrings.data(), 0, blocks, blockSize, tables, prefixMin.data(), suffixMin.data(), blockMin.data(), (SimdLevel)level);
+            output.insert(output.end(), prefixMin.begin(), prefixMin.end());
+            output.insert(output.end(), suffixMin.begin(), suffixMin.end());
+            output.insert(output.end(), blockMin.begin(), blockMin.end());
+
+            std::vector<int> levelIndex(windows), levelDepth(windows);
+            sparseTableLevel(index.data(), seq.data(), 0, windows, half, levelIndex.data(), levelDepth.data(), (SimdLevel)level);
+            output.insert(output.end(), levelIndex.begin(), levelIndex.end());
+            output.insert(output.end(), levelDepth.begin(), levelDepth.end());
+            outputs.push_back(output);
+        }
+
+        for (int level = SIMD_AVX2; level < outputs.size(); level++)
+        {
+            for (int i = 0; i < outputs[0].size(); i++)
+            {
+                if (outputs[level][i] == outputs[SIMD_SCALAR][i])
+                {
+                    correct++;
+                }
+                total++;
+            }
+        }
+    }
+
+    std::cout << "\n\t******* Total correct kernel outputs: " << correct << "/" << total << "\n\n";
 }
@@ -16,4 +16,43 @@ void dfsNextNodeOnPathSamples(int root,
                               std::vector<bool> &visited,
                               std::vector<std::vector<int>> &testSamples);
 
+// Concurrent queries test
+void testConcurrentQueries();
+
+// DynamicTree Test
+void testDynamicTree();
+
+// IncrementalNextNodeOnPath Test
+void testIncrementalNextNodeOnPath();
+
+// Forest Test
+void testForest();
+
+// Pre-order relabeling Test
+void testNodeRelabeling();
+
+// Array memory Test
+void testArrayMemory();
+
+// SuccinctTree Test
+void testSuccinctTree();
+
+// PathAggregate Test
+void testPathAggregate();
+
+// EulerNextNodeOnPath Test
+void testEulerNextNodeOnPath();
+
+// Offline queries Test
+void testOfflineQueries();
+
+// Query cache Test
+void testQueryCache();
+
+// Tree file loader Test
+void testTreeLoader();
+
+// Preprocessing kernels Test
+void testBlockKernels();
+
 #endif // TESTUTILS_HPP
\ No newline at end of file
@@ -0,0 +1,324 @@
+#include "TreeLoader.hpp"
+#include <vector>
+#include <future>
+#include <stdexcept>
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const char *treeFileFormatName(TreeFileFormat format)
+{
+    switch (format)
+    {
+    case TREE_FILE_PARENT_BINARY:
+        return "parent-binary";
+    case TREE_FILE_PARENT_TEXT:
+        return "parent-text";
+    case TREE_FILE_EDGES_BINARY:
+        return "edges-binary";
+    case TREE_FILE_EDGES_TEXT:
+        return "edges-text";
+    }
+    return "unknown";
+}
+
+/*
+Reads a file in blocks of TREE_LOADER_BLOCK_BYTES, into two buffers in turn: the next block is read
+in the background while the caller parses the current one. Every block but the last one is full.
+*/
+class BlockReader
+{
+public:
+    explicit BlockReader(const std::string &path) : path(path), current(0)
+    {
+        fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1)
+        {
+            throw std::runtime_error("Cannot open tree file: " + path);
+        }
+        buffers[0].resize(TREE_LOADER_BLOCK_BYTES);
+        buffers[1].resize(TREE_LOADER_BLOCK_BYTES);
+        pending = std::async(std::launch::async, &BlockReader::fill, this, 0);
+    }
+
+    ~BlockReader()
+    {
+        if (pending.valid())
+        {
+            pending.wait();
+        }
+        close(fd);
+    }
+
+    // returns the size of the next block, 0 at the end of the file
+    size_t next(const char *&data)
+    {
+        if (!pending.valid())
+        {
+            return 0;
+        }
+        size_t size = pending.get();
+        data = buffers[current].data();
+        current = 1 - current;
+        if (size == TREE_LOADER_BLOCK_BYTES)
+        {
+            pending = std::async(std::launch::async, &BlockReader::fill, this, current);
+        }
+        return size;
+    }
+
+    // returns the size of the file, in bytes
+    size_t fileSize() const
+    {
+        struct stat status;
+        return fstat(fd, &status) == 0 ? status.st_size : 0;
+    }
+
+private:
+    std::string path;
+    int fd;
+    std::vector<char> buffers[2];
+    int current; // buffer of the block being read, then of the next block returned
+    std::future<size_t> pending;
+
+    size_t fill(int buffer)
+    {
+        size_t size = 0;
+        while (size < TREE_LOADER_BLOCK_BYTES)
+        {
+            ssize_t got = read(fd, buffers[buffer].data() + size, TREE_LOADER_BLOCK_BYTES - size);
+            if (got < 0)
+            {
+                throw std::runtime_error("Cannot read tree file: " + path);
+            }
+            if (got == 0)
+            {
+                break;
+            }
+            size += got;
+        }
+        return size;
+    }
+
+    BlockReader(const BlockReader &) = delete;
+    BlockReader &operator=(const BlockReader &) = delete;
+};
+
+/*
+Calls emit(value) for each integer of a text file, in order. Numbers may straddle blocks, so the
+parser keeps its state from one block to the next.
+*/
+template <typename F>
+static void parseText(BlockReader &reader, const std::string &path, F emit)
+{
+    long long value = 0;
+    bool inNumber = false, negative = false;
+    const char *data;
+    size_t size;
+    while ((size = reader.next(data)) > 0)
+    {
+        for (size_t k = 0; k < size; k++)
+        {
+            char c = data[k];
+            if (c >= '0' && c <= '9')
+            {
+                value = value * 10 + (c - '0');
+                inNumber = true;
+                if (value > INT_MAX)
+                {
+                    throw std::runtime_error("Integer out of range in tree file: " + path);
+                }
+            }
+            else if (c == '-' && !inNumber && !negative)
+            {
+                negative = true;
+            }
+            else if (c == ' ' || c == '\n' || c == '\t' || c == '\r')
+            {
+                if (negative && !inNumber) // a lone minus sign
+                {
+                    throw std::runtime_error("Invalid character in tree file: " + path);
+                }
+                if (inNumber)
+                {
+                    emit((int)(negative ? -value : value));
+                }
+                value = 0;
+                inNumber = negative = false;
+            }
+            else
+            {
+                throw std::runtime_error("Invalid character in tree file: " + path);
+            }
+        }
+    }
+    if (negative && !inNumber)
+    {
+        throw std::runtime_error("Invalid character in tree file: " + path);
+    }
+    if (inNumber)
+    {
+        emit((int)(negative ? -value : value));
+    }
+}
+
+// Calls emit(value) for each native int32 of a binary file, in order
+template <typename F>
+static void parseBinary(BlockReader &reader, const std::string &path, F emit)
+{
+    const char *data;
+    size_t size;
+    while ((size = reader.next(data)) > 0)
+    {
+        if (size % sizeof(int32_t) != 0) // blocks hold whole integers, so only the last one can end early
+        {
+            throw std::runtime_error("Tree file is truncated: " + path);
+        }
+        for (size_t k = 0; k < size; k += sizeof(int32_t))
+        {
+            int32_t value;
+            std::memcpy(&value, data + k, sizeof(int32_t));
+            emit(value);
+        }
+    }
+}
+
+static CSRTree loadParentArray(const std::string &path, bool binary)
+{
+    BlockReader reader(path);
+    std::vector<int> parent;
+    if (binary)
+    {
+        parent.reserve(reader.fileSize() / sizeof(int32_t));
+    }
+    auto emit = [&](int p) { parent.push_back(p); };
+    if (binary)
+    {
+        parseBinary(reader, path, emit);
+    }
+    else
+    {
+        parseText(reader, path, emit);
+    }
+
+    try
+    {
+        return CSRTree(std::move(parent));
+    }
+    catch (const std::exception &error)
+    {
+        throw std::runtime_error(std::string("Parent array does not form a tree (") + error.what() + "): " + path);
+    }
+}
+
+/*
+Each node accumulates its degree and the XOR of its neighbours. A leaf other than the root has a
+single neighbour left, its parent: peeling it off its parent's XOR and degree may make the parent
+a leaf in turn, and so on. All the nodes but the root are peeled iff the edges form a tree, and
+the XOR of each of them is then its parent.
+*/
+static CSRTree loadEdgeList(const std::string &path, bool binary, int root)
+{
+    if (root < 0)
+    {
+        throw std::runtime_error("Root index out of bounds.");
+    }
+    BlockReader reader(path);
+    std::vector<int> degree, neighbours;
+    if (binary)
+    {
+        size_t nodes = reader.fileSize() / (2 * sizeof(int32_t)) + 1;
+        degree.reserve(nodes);
+        neighbours.reserve(nodes);
+    }
+
+    long long edges = 0;
+    int maxIndex = -1, endpoint = -1;
+    auto emit = [&](int v)
+    {
+        if (v < 0)
+        {
+            throw std::runtime_error("Negative node index in tree file: " + path);
+        }
+        if (v >= (int)degree.size())
+        {
+            size_t size = std::max<size_t>(v + 1, 2 * degree.size());
+            degree.resize(size);
+            neighbours.resize(size);
+        }
+        maxIndex = std::max(maxIndex, v);
+        if (endpoint == -1)
+        {
+            endpoint = v;
+            return;
+        }
+        degree[endpoint]++;
+        degree[v]++;
+        neighbours[endpoint] ^= v;
+        neighbours[v] ^= endpoint;
+        edges++;
+        endpoint = -1;
+    };
+    if (binary)
+    {
+        parseBinary(reader, path, emit);
+    }
+    else
+    {
+        parseText(reader, path, emit);
+    }
+    if (endpoint != -1)
+    {
+        throw std::runtime_error("Edge list has an odd number of node indices: " + path);
+    }
+
+    int n = std::max(maxIndex, root) + 1;
+    degree.resize(n);
+    neighbours.resize(n);
+    if (edges != n - 1)
+    {
+        throw std::runtime_error("Edge list does not form a tree: " + path);
+    }
+
+    int peeled = 0;
+    for (int v = 0; v < n; v++)
+    {
+        for (int u = v; u != root && degree[u] == 1;)
+        {
+            int p = neighbours[u];
+            degree[u] = 0;
+            degree[p]--;
+            neighbours[p] ^= u;
+            peeled++;
+            u = p;
+        }
+    }
+    if (peeled != n - 1)
+    {
+        throw std::runtime_error("Edge list does not form a tree: " + path);
+    }
+
+    std::vector<int>().swap(degree);
+    neighbours[root] = -1;
+    return CSRTree(std::move(neighbours));
+}
+
+CSRTree loadTree(const std::string &path, TreeFileFormat format, int root)
+{
+    switch (format)
+    {
+    case TREE_FILE_PARENT_BINARY:
+        return loadParentArray(path, true);
+    case TREE_FILE_PARENT_TEXT:
+        return loadParentArray(path, false);
+    case TREE_FILE_EDGES_BINARY:
+        return loadEdgeList(path, true, root);
+    case TREE_FILE_EDGES_TEXT:
+        return loadEdgeList(path, false, root);
+    }
+    throw std::invalid_argument("Unknown tree file format.");
+}
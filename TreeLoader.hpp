@@ -0,0 +1,35 @@
+#ifndef TREELOADER_HPP
+#define TREELOADER_HPP
+
+#include <string>
+#include "CSRTree.hpp"
+
+// Bytes read from a tree file at a time
+#define TREE_LOADER_BLOCK_BYTES (4 << 20)
+
+// Layouts of tree files
+enum TreeFileFormat
+{
+    TREE_FILE_PARENT_BINARY = 0, // parent of each node as a native int32, -1 for the root
+    TREE_FILE_PARENT_TEXT = 1,   // parent of each node as a decimal integer, -1 for the root
+    TREE_FILE_EDGES_BINARY = 2,  // the n - 1 undirected edges, as pairs of native int32 node indices
+    TREE_FILE_EDGES_TEXT = 3     // the n - 1 undirected edges, as pairs of decimal node indices
+};
+
+const char *treeFileFormatName(TreeFileFormat format);
+
+/**
+ * Loads a tree from a file, straight into the arrays of a CSRTree: no per-node child lists are
+ * built. The file is streamed in blocks of TREE_LOADER_BLOCK_BYTES, the next block being read in
+ * the background while the current one is parsed. Text files hold integers separated by any
+ * whitespace.
+ * A parent array gives the parent of nodes 0...n - 1 in turn. An edge list is unrooted: the
+ * nodes are 0...n - 1, n being one more than the largest index, and the tree is hung from root.
+ * It is oriented from the degree and the XOR of the neighbours of each node, accumulated while
+ * parsing, by peeling leaves towards the root, so that the edges are never stored.
+ * Throws std::runtime_error if the file cannot be read or does not hold a tree.
+ * @param root root of an edge list (a parent array has its own)
+ */
+CSRTree loadTree(const std::string &path, TreeFileFormat format, int root = 0);
+
+#endif // TREELOADER_HPP
@@ -0,0 +1,963 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <random>
+#include <cmath>
+#include <sstream>
+#include "RMQ.hpp"
+#include "LCA.hpp"
+#include "NextNodeOnPath.hpp"
+#include "CSRTree.hpp"
+#include "DynamicTree.hpp"
+#include "IncrementalNextNodeOnPath.hpp"
+#include "Forest.hpp"
+#include "BlockKernels.hpp"
+#include "Memory.hpp"
+#include "SuccinctTree.hpp"
+#include "PathAggregate.hpp"
+#include "EulerNextNodeOnPath.hpp"
+#include "OfflineQueries.hpp"
+#include "QueryCache.hpp"
+#include "BenchUtils.hpp"
+
+/*
+Benchmark suite for preprocessing and query throughput, over tree sizes 10^minExp...10^maxExp,
+tree shapes and query distributions. Usage:
+    ./bench [--min-exp 3] [--max-exp 7] [--queries 1000000] [--min-time 0.5]
+            [--shapes random,path,star,kary,caterpillar] [--csv bench_results.csv] [--json bench_results.json]
+            [--dynamic-max-exp 5] [--kernel-exp 8]
+The dynamic benchmarks (DynamicTree against rebuilding NextNodeOnPath after every update) run
+for tree sizes up to 10^dynamicMaxExp, since rebuilding dominates their running time.
+The LCA preprocessing kernels run once per supported instruction set, on a +/-1 sequence of
+10^kernelExp elements (0 skips them), and also report GB/s of sequence processed.
+*/
+
+struct BenchOptions
+{
+    int minExp = 3;
+    int maxExp = 7;
+    size_t queries = 1000000;
+    double minTime = 0.5;
+    int dynamicMaxExp = 5;
+    int kernelExp = 8;
+    std::vector<TreeShape> shapes = {SHAPE_RANDOM, SHAPE_PATH, SHAPE_STAR, SHAPE_KARY, SHAPE_CATERPILLAR};
+    std::string csvPath = "bench_results.csv";
+    std::string jsonPath = "bench_results.json";
+};
+
+static const QueryDistribution DISTRIBUTIONS[] = {QUERIES_UNIFORM, QUERIES_ANCESTOR, QUERIES_SAME_BLOCK, QUERIES_FAR_APART, QUERIES_MIXED};
+
+static void report(std::vector<BenchResult> &results, const BenchResult &result)
+{
+    std::string name = result.benchmark + "/" + result.shape + (result.distribution.empty() ? "" : "/" + result.distribution);
+    std::cout << std::left << std::setw(48) << name << std::right << std::setw(11) << result.size
+              << std::setw(14) << std::fixed << std::setprecision(4) << result.time << " us"
+              << std::setw(8) << result.iterations << " runs" << std::endl;
+    results.push_back(result);
+}
+
+// reports a kernel result, also as GB/s of 32-bit input elements
+static void reportKernel(std::vector<BenchResult> &results, const BenchResult &result)
+{
+    report(results, result);
+    std::cout << std::setw(59) << std::fixed << std::setprecision(2) << 4e-9 * result.throughput << " GB/s" << std::endl;
+}
+
+static void benchRMQ(int n, const BenchOptions &options, std::mt19937 &rng, std::vector<BenchResult> &results)
+{
+    std::vector<int> seq(n);
+    for (int &x : seq)
+    {
+        x = rng();
+    }
+
+    std::vector<double> runTimes = measure([&]() { RMQ<int> rmq(seq); }, options.minTime);
+    report(results, makeResult("RMQ/preprocess", "random", "", n, runTimes, 1));
+
+    RMQ<int> rmq(seq);
+    const QueryDistribution rangeDistributions[] = {QUERIES_UNIFORM, QUERIES_SAME_BLOCK, QUERIES_FAR_APART};
+    for (QueryDistribution distribution : rangeDistributions)
+    {
+        // ranges: uniform ends, at most 32 elements, or spanning from the first to the last 1%
+        std::vector<int> from(options.queries), to(options.queries);
+        int edge = std::max(1, n / 100);
+        for (size_t q = 0; q < options.queries; q++)
+        {
+            if (distribution == QUERIES_UNIFORM)
+            {
+                from[q] = rng() % n;
+                to[q] = rng() % n;
+            }
+            else if (distribution == QUERIES_SAME_BLOCK)
+            {
+                from[q] = rng() % n;
+                to[q] = std::min(n - 1, from[q] + (int)(rng() % 32));
+            }
+            else
+            {
+                from[q] = rng() % edge;
+                to[q] = n - 1 - rng() % edge;
+            }
+        }
+
+        runTimes = measure([&]()
+        {
+            long sum = 0;
+            for (size_t q = 0; q < from.size(); q++)
+            {
+                sum += rmq.rangeMin(from[q], to[q]);
+            }
+            doNotOptimize(sum);
+        }, options.minTime);
+        report(results, makeResult("RMQ/rangeMin", "random", queryDistributionName(distribution), n, runTimes, options.queries));
+    }
+}
+
+static void benchTree(int n, TreeShape shape, const BenchOptions &options, std::mt19937 &rng, std::vector<BenchResult> &results)
+{
+    std::vector<int> parent = generateTree(shape, n, rng);
+    std::vector<int> preOrder = preOrderTraversal(parent);
+    CSRTree tree(parent);
+    const char *shapeName = treeShapeName(shape);
+
+    std::vector<std::vector<int>> src(5), dst(5);
+    for (QueryDistribution distribution : DISTRIBUTIONS)
+    {
+        generateQueries(distribution, parent, preOrder, options.queries, rng, src[distribution], dst[distribution]);
+    }
+
+    // LCA
+    {
+        std::vector<double> runTimes = measure([&]() { LCA lca(tree.view()); }, options.minTime);
+        report(results, makeResult("LCA/preprocess", shapeName, "", n, runTimes, 1));
+
+        LCA lca(tree.view());
+        for (QueryDistribution distribution : DISTRIBUTIONS)
+        {
+            const std::vector<int> &s = src[distribution], &d = dst[distribution];
+            runTimes = measure([&]()
+            {
+                long sum = 0;
+                for (size_t q = 0; q < s.size(); q++)
+                {
+                    sum += lca.lca(s[q], d[q]);
+                }
+                doNotOptimize(sum);
+            }, options.minTime);
+            report(results, makeResult("LCA/lca", shapeName, queryDistributionName(distribution), n, runTimes, s.size()));
+        }
+    }
+
+    // NextNodeOnPath
+    {
+        std::vector<double> runTimes = measure([&]() { NextNodeOnPath nextNodeOnPath(tree.view()); }, options.minTime);
+        report(results, makeResult("NextNodeOnPath/preprocess", shapeName, "", n, runTimes, 1));
+
+        NextNodeOnPath nextNodeOnPath(tree.view());
+        std::vector<int> out(options.queries);
+        for (QueryDistribution distribution : DISTRIBUTIONS)
+        {
+            const std::vector<int> &s = src[distribution], &d = dst[distribution];
+            runTimes = measure([&]()
+            {
+                long sum = 0;
+                for (size_t q = 0; q < s.size(); q++)
+                {
+                    if (s[q] != d[q])
+                        sum += nextNodeOnPath.query(s[q], d[q]);
+                }
+                doNotOptimize(sum);
+            }, options.minTime);
+            report(results, makeResult("NextNodeOnPath/query", shapeName, queryDistributionName(distribution), n, runTimes, s.size()));
+
+            runTimes = measure([&]()
+            {
+                nextNodeOnPath.queryBatch(s.data(), d.data(), out.data(), s.size());
+                doNotOptimize(out[0]);
+            }, options.minTime);
+            report(results, makeResult("NextNodeOnPath/queryBatch", shapeName, queryDistributionName(distribution), n, runTimes, s.size()));
+        }
+    }
+
+    // EulerNextNodeOnPath, with the memory of both engines
+    {
+        std::vector<double> runTimes = measure([&]() { EulerNextNodeOnPath engine(tree.view()); }, options.minTime);
+        report(results, makeResult("EulerNextNodeOnPath/preprocess", shapeName, "", n, runTimes, 1));
+
+        CountingMemory eulerMemory, nextNodeOnPathMemory;
+        {
+            ScopedArrayMemory scope(&eulerMemory);
+            EulerNextNodeOnPath engine(tree.view());
+        }
+        {
+            ScopedArrayMemory scope(&nextNodeOnPathMemory);
+            NextNodeOnPath nextNodeOnPath(tree.view());
+        }
+        std::cout << std::setw(59) << std::fixed << std::setprecision(2) << (double)eulerMemory.allocated() / n
+                  << " bytes/node, NextNodeOnPath " << (double)nextNodeOnPathMemory.allocated() / n << std::endl;
+
+        EulerNextNodeOnPath engine(tree.view());
+        std::vector<int> out(options.queries);
+        for (QueryDistribution distribution : DISTRIBUTIONS)
+        {
+            const std::vector<int> &s = src[distribution], &d = dst[distribution];
+            runTimes = measure([&]()
+            {
+                long sum = 0;
+                for (size_t q = 0; q < s.size(); q++)
+                {
+                    sum += engine.query(s[q], d[q]);
+                }
+                doNotOptimize(sum);
+            }, options.minTime);
+            report(results, makeResult("EulerNextNodeOnPath/query", shapeName, queryDistributionName(distribution), n, runTimes, s.size()));
+
+            runTimes = measure([&]()
+            {
+                engine.queryBatch(s.data(), d.data(), out.data(), s.size());
+                doNotOptimize(out[0]);
+            }, options.minTime);
+            report(results, makeResult("EulerNextNodeOnPath/queryBatch", shapeName, queryDistributionName(distribution), n, runTimes, s.size()));
+        }
+    }
+}
+
+// A tree update: v is re-parented under p, or a new leaf is added under p if v == -1
+struct TreeUpdate
+{
+    int v;
+    int p;
+};
+
+/*
+Compares DynamicTree with rebuilding NextNodeOnPath after each update, for update-to-query ratios
+from 1:10 to 1:10^6. Each round applies one update (a new leaf or a re-parented subtree) and then
+answers `ratio` uniform queries; the result is the time per round.
+*/
+static void benchDynamic(int n, const BenchOptions &options, std::mt19937 &rng, std::vector<BenchResult> &results)
+{
+    for (long ratio = 10; ratio <= 1000000; ratio *= 10)
+    {
+        int rounds = std::max(1L, std::min(20L, 1000000 / ratio));
+
+        // generate the updates up front, using a DynamicTree to reject re-parentings that would create cycles
+        std::vector<int> parent = generateTree(SHAPE_RANDOM, n, rng);
+        CSRTree initialTree(parent);
+        std::vector<TreeUpdate> updates;
+        {
+            DynamicTree planner(initialTree.view());
+            while (updates.size() < rounds)
+            {
+                TreeUpdate update;
+                update.p = rng() % planner.size();
+                update.v = rng() % 2 == 0 ? -1 : 1 + rng() % (planner.size() - 1);
+                if (update.v == -1)
+                {
+                    planner.addLeaf(update.p);
+                }
+                else if (planner.lca(update.v, update.p) != update.v)
+                {
+                    planner.cut(update.v);
+                    planner.link(update.v, update.p);
+                }
+                else
+                {
+                    continue;
+                }
+                updates.push_back(update);
+            }
+        }
+        std::vector<int> src(ratio), dst(ratio);
+        for (long q = 0; q < ratio; q++)
+        {
+            src[q] = rng() % n;
+            dst[q] = rng() % n;
+        }
+
+        std::vector<double> runTimes = measure([&]()
+        {
+            DynamicTree dynamicTree(initialTree.view());
+            long sum = 0;
+            for (const TreeUpdate &update : updates)
+            {
+                if (update.v == -1)
+                {
+                    dynamicTree.addLeaf(update.p);
+                }
+                else
+                {
+                    dynamicTree.cut(update.v);
+                    dynamicTree.link(update.v, update.p);
+                }
+                for (long q = 0; q < ratio; q++)
+                {
+                    sum += dynamicTree.query(src[q], dst[q]);
+                }
+            }
+            doNotOptimize(sum);
+        }, options.minTime, 3);
+        std::string distribution = "1:" + std::to_string(ratio);
+        report(results, makeResult("Dynamic/linkCut", "random", distribution, n, runTimes, rounds));
+
+        runTimes = measure([&]()
+        {
+            std::vector<int> currentParent(parent);
+            long sum = 0;
+            for (const TreeUpdate &update : updates)
+            {
+                if (update.v == -1)
+                {
+                    currentParent.push_back(update.p);
+                }
+                else
+                {
+                    currentParent[update.v] = update.p;
+                }
+                CSRTree tree(currentParent);
+                NextNodeOnPath nextNodeOnPath(tree.view());
+                for (long q = 0; q < ratio; q++)
+                {
+                    if (src[q] != dst[q])
+                        sum += nextNodeOnPath.query(src[q], dst[q]);
+                }
+            }
+            doNotOptimize(sum);
+        }, options.minTime, 3);
+        report(results, makeResult("Dynamic/rebuild", "random", distribution, n, runTimes, rounds));
+    }
+}
+
+/*
+Appends n/8 leaves to IncrementalNextNodeOnPath, including the background rebuilds they trigger,
+then times uniform queries over a tree grown by n/8 leaves without rebuilding, all in the overlay.
+*/
+static void benchIncremental(int n, const BenchOptions &options, std::mt19937 &rng, std::vector<BenchResult> &results)
+{
+    std::vector<int> parent = generateTree(SHAPE_RANDOM, n, rng);
+    CSRTree tree(parent);
+    int leaves = std::max(1, n / 8);
+    std::vector<int> leafParent(leaves);
+    for (int k = 0; k < leaves; k++)
+    {
+        leafParent[k] = rng() % (n + k);
+    }
+
+    std::vector<double> runTimes = measure([&]()
+    {
+        IncrementalNextNodeOnPath nextNodeOnPath(tree.view());
+        for (int p : leafParent)
+        {
+            nextNodeOnPath.addLeaf(p);
+        }
+        nextNodeOnPath.waitForRebuild();
+    }, options.minTime);
+    report(results, makeResult("Incremental/addLeaf", "random", "", n, runTimes, leaves));
+
+    IncrementalNextNodeOnPath nextNodeOnPath(tree.view(), leaves + 1);
+    for (int p : leafParent)
+    {
+        nextNodeOnPath.addLeaf(p);
+    }
+    std::vector<int> src(options.queries), dst(options.queries);
+    for (size_t q = 0; q < options.queries; q++)
+    {
+        src[q] = rng() % (n + leaves);
+        dst[q] = rng() % (n + leaves);
+    }
+    runTimes = measure([&]()
+    {
+        long sum = 0;
+        for (size_t q = 0; q < src.size(); q++)
+        {
+            sum += nextNodeOnPath.query(src[q], dst[q]);
+        }
+        doNotOptimize(sum);
+    }, options.minTime);
+    report(results, makeResult("Incremental/query", "random", "uniform", n, runTimes, src.size()));
+}
+
+/*
+Splits n nodes into random trees of 100 to 1000 nodes, and compares one Forest over all of them
+with one NextNodeOnPath per tree, for preprocessing and for uniform queries within a random tree.
+*/
+static void benchForest(int n, const BenchOptions &options, std::mt19937 &rng, std::vector<BenchResult> &results)
+{
+    std::vector<CSRTree> csrTrees;
+    std::vector<TreeView> trees;
+    for (int remaining = n; remaining > 0;)
+    {
+        int treeSize = std::min(remaining, 100 + (int)(rng() % 901));
+        csrTrees.push_back(CSRTree(generateTree(SHAPE_RANDOM, treeSize, rng)));
+        remaining -= treeSize;
+    }
+    for (const CSRTree &tree : csrTrees)
+    {
+        trees.push_back(tree.view());
+    }
+
+    std::vector<double> runTimes = measure([&]() { Forest forest(trees); }, options.minTime);
+    report(results, makeResult("Forest/preprocess", "random", "", n, runTimes, 1));
+    runTimes = measure([&]()
+    {
+        std::vector<NextNodeOnPath> perTree;
+        perTree.reserve(trees.size());
+        for (const TreeView &tree : trees)
+        {
+            perTree.push_back(NextNodeOnPath(tree, 1));
+        }
+    }, options.minTime);
+    report(results, makeResult("PerTree/preprocess", "random", "", n, runTimes, 1));
+
+    Forest forest(trees);
+    std::vector<NextNodeOnPath> perTree;
+    perTree.reserve(trees.size());
+    for (const TreeView &tree : trees)
+    {
+        perTree.push_back(NextNodeOnPath(tree, 1));
+    }
+    std::vector<int> treeIndex(options.queries), src(options.queries), dst(options.queries);
+    for (size_t q = 0; q < options.queries; q++)
+    {
+        treeIndex[q] = rng() % trees.size();
+        do
+        {
+            src[q] = rng() % trees[treeIndex[q]].size;
+            dst[q] = rng() % trees[treeIndex[q]].size;
+        } while (src[q] == dst[q]);
+    }
+
+    runTimes = measure([&]()
+    {
+        long sum = 0;
+        for (size_t q = 0; q < src.size(); q++)
+        {
+            sum += forest.query(treeIndex[q], src[q], dst[q]);
+        }
+        doNotOptimize(sum);
+    }, options.minTime);
+    report(results, makeResult("Forest/query", "random", "uniform", n, runTimes, src.size()));
+    runTimes = measure([&]()
+    {
+        long sum = 0;
+        for (size_t q = 0; q < src.size(); q++)
+        {
+            sum += perTree[treeIndex[q]].query(src[q], dst[q]);
+        }
+        doNotOptimize(sum);
+    }, options.minTime);
+    report(results, makeResult("PerTree/query", "random", "uniform", n, runTimes, src.size()));
+}
+
+/*
+Compares NextNodeOnPath with and without pre-order relabeling on a random tree whose ids are
+randomly permuted, so that the caller's ids say nothing about where nodes are in the tree.
+*/
+static void benchRelabel(int n, const BenchOptions &options, std::mt19937 &rng, std::vector<BenchResult> &results)
+{
+    std::vector<int> generated = generateTree(SHAPE_RANDOM, n, rng);
+    std::vector<int> ids(n);
+    for (int v = 0; v < n; v++)
+    {
+        ids[v] = v;
+    }
+    std::shuffle(ids.begin(), ids.end(), rng);
+    std::vector<int> parent(n);
+    for (int v = 0; v < n; v++)
+    {
+        parent[ids[v]] = generated[v] == -1 ? -1 : ids[generated[v]];
+    }
+    CSRTree tree(std::move(parent));
+
+    std::vector<double> runTimes = measure([&]() { NextNodeOnPath nextNodeOnPath(tree.view(), 0, NODE_ORDER_PRE_ORDER); }, options.minTime);
+    report(results, makeResult("PreOrder/preprocess", "scattered", "", n, runTimes, 1));
+
+    std::vector<int> src(options.queries), dst(options.queries), out(options.queries);
+    for (size_t q = 0; q < options.queries; q++)
+    {
+        do
+        {
+            src[q] = rng() % n;
+            dst[q] = rng() % n;
+        } while (n > 1 && src[q] == dst[q]);
+    }
+
+    const NodeOrder orders[] = {NODE_ORDER_INPUT, NODE_ORDER_PRE_ORDER};
+    const char *names[] = {"InputOrder", "PreOrder"};
+    for (int o = 0; o < 2; o++)
+    {
+        NextNodeOnPath nextNodeOnPath(tree.view(), 0, orders[o]);
+        runTimes = measure([&]()
+        {
+            long sum = 0;
+            for (size_t q = 0; q < src.size(); q++)
+            {
+                if (src[q] != dst[q])
+                    sum += nextNodeOnPath.query(src[q], dst[q]);
+            }
+            doNotOptimize(sum);
+        }, options.minTime);
+        report(results, makeResult(std::string(names[o]) + "/query", "scattered", "uniform", n, runTimes, src.size()));
+
+        runTimes = measure([&]()
+        {
+            nextNodeOnPath.queryBatch(src.data(), dst.data(), out.data(), src.size());
+            doNotOptimize(out[0]);
+        }, options.minTime);
+        report(results, makeResult(std::string(names[o]) + "/queryBatch", "scattered", "uniform", n, runTimes, src.size()));
+    }
+}
+
+/*
+Compares uniform NextNodeOnPath queries with the arrays in each kind of array memory (Memory.hpp)
+on a random tree: the heap, a PageMemory for each page size, interleaved over the NUMA nodes, and
+one replica per node. Alongside the latency, it prints the data TLB misses per query, when the CPU
+counters are available, and how much of the process is backed by transparent huge pages.
+*/
+static void benchMemory(int n, const BenchOptions &options, std::mt19937 &rng, std::vector<BenchResult> &results)
+{
+    CSRTree tree(generateTree(SHAPE_RANDOM, n, rng));
+    std::vector<int> src(options.queries), dst(options.queries);
+    for (size_t q = 0; q < options.queries; q++)
+    {
+        do
+        {
+            src[q] = rng() % n;
+            dst[q] = rng() % n;
+        } while (n > 1 && src[q] == dst[q]);
+    }
+
+    TlbMissCounter tlbMisses;
+    auto run = [&](const std::string &name, const NextNodeOnPath &nextNodeOnPath)
+    {
+        auto queries = [&]()
+        {
+            long sum = 0;
+            for (size_t q = 0; q < src.size(); q++)
+            {
+                if (src[q] != dst[q])
+                    sum += nextNodeOnPath.query(src[q], dst[q]);
+            }
+            doNotOptimize(sum);
+        };
+        std::vector<double> runTimes = measure(queries, options.minTime);
+        report(results, makeResult("Memory/query", name, "uniform", n, runTimes, src.size()));
+
+        tlbMisses.start();
+        queries();
+        long misses = tlbMisses.stop();
+        std::cout << std::setw(59) << std::fixed << std::setprecision(2);
+        if (misses >= 0)
+            std::cout << (double)misses / src.size();
+        else
+            std::cout << "n/a";
+        std::cout << " dTLB misses/query, " << anonHugePageBytes() / (1 << 20) << " MB in huge pages" << std::endl;
+    };
+
+    run("heap", NextNodeOnPath(tree.view()));
+
+    const PageSize pageSizes[] = {PAGES_SMALL, PAGES_TRANSPARENT, PAGES_HUGE_2MB, PAGES_HUGE_1GB};
+    for (PageSize pages : pageSizes)
+    {
+        PageMemory memory(pages);
+        ScopedArrayMemory scope(&memory);
+        NextNodeOnPath nextNodeOnPath(tree.view());
+        run(std::string(pageSizeName(pages)) + (memory.fallbacks() ? "(fallback)" : ""), nextNodeOnPath);
+    }
+
+    {
+        PageMemory memory(PAGES_TRANSPARENT, NUMA_INTERLEAVE);
+        ScopedArrayMemory scope(&memory);
+        NextNodeOnPath nextNodeOnPath(tree.view());
+        run(std::string("interleave") + (memory.fallbacks() ? "(fallback)" : ""), nextNodeOnPath);
+    }
+
+    NumaReplicated<NextNodeOnPath> replicated(NextNodeOnPath(tree.view()));
+    run("replicated", replicated.local());
+}
+
+/*
+Compares SuccinctTree with NextNodeOnPath on a random tree: preprocessing, memory per node
+(the arrays of NextNodeOnPath are counted through a CountingMemory) and uniform queries.
+*/
+static void benchSuccinct(int n, const BenchOptions &options, std::mt19937 &rng, std::vector<BenchResult> &results)
+{
+    CSRTree tree(generateTree(SHAPE_RANDOM, n, rng));
+    std::vector<int> src(options.queries), dst(options.queries);
+    for (size_t q = 0; q < options.queries; q++)
+    {
+        do
+        {
+            src[q] = rng() % n;
+            dst[q] = rng() % n;
+        } while (n > 1 && src[q] == dst[q]);
+    }
+
+    std::vector<double> runTimes = measure([&]() { SuccinctTree succinct(tree.view()); }, options.minTime);
+    report(results, makeResult("Succinct/preprocess", "random", "", n, runTimes, 1));
+
+    SuccinctTree succinct(tree.view());
+    CountingMemory counting;
+    {
+        ScopedArrayMemory scope(&counting);
+        NextNodeOnPath nextNodeOnPath(tree.view());
+    }
+    std::cout << std::setw(59) << std::fixed << std::setprecision(2) << 8.0 * succinct.sizeInBytes() / n
+              << " bits/node, NextNodeOnPath " << 8.0 * counting.allocated() / n << std::endl;
+
+    runTimes = measure([&]()
+    {
+        long sum = 0;
+        for (size_t q = 0; q < src.size(); q++)
+        {
+            if (src[q] != dst[q])
+                sum += succinct.query(src[q], dst[q]);
+        }
+        doNotOptimize(sum);
+    }, options.minTime);
+    report(results, makeResult("Succinct/query", "random", "uniform", n, runTimes, src.size()));
+
+    runTimes = measure([&]()
+    {
+        long sum = 0;
+        for (size_t q = 0; q < src.size(); q++)
+        {
+            sum += succinct.lca(src[q], dst[q]);
+        }
+        doNotOptimize(sum);
+    }, options.minTime);
+    report(results, makeResult("Succinct/lca", "random", "uniform", n, runTimes, src.size()));
+}
+
+/*
+Compares offline LCA and next-node-on-path queries with building the online structures and then
+answering the same uniform batch, on a random tree used once: each result is the whole time per
+query, preprocessing included.
+*/
+static void benchOffline(int n, const BenchOptions &options, std::mt19937 &rng, std::vector<BenchResult> &results)
+{
+    CSRTree tree(generateTree(SHAPE_RANDOM, n, rng));
+    std::vector<int> src(options.queries), dst(options.queries), out(options.queries);
+    for (size_t q = 0; q < options.queries; q++)
+    {
+        src[q] = rng() % n;
+        dst[q] = rng() % n;
+    }
+
+    std::vector<double> runTimes = measure([&]()
+    {
+        LCA lca(tree.view());
+        lca.lcaBatch(src.data(), dst.data(), out.data(), src.size());
+        doNotOptimize(out[0]);
+    }, options.minTime);
+    report(results, makeResult("Online/lca", "random", "uniform", n, runTimes, src.size()));
+
+    runTimes = measure([&]()
+    {
+        offlineLCA(tree.view(), src.data(), dst.data(), out.data(), src.size());
+        doNotOptimize(out[0]);
+    }, options.minTime);
+    report(results, makeResult("Offline/lca", "random", "uniform", n, runTimes, src.size()));
+
+    runTimes = measure([&]()
+    {
+        NextNodeOnPath nextNodeOnPath(tree.view());
+        nextNodeOnPath.queryBatch(src.data(), dst.data(), out.data(), src.size());
+        doNotOptimize(out[0]);
+    }, options.minTime);
+    report(results, makeResult("Online/query", "random", "uniform", n, runTimes, src.size()));
+
+    runTimes = measure([&]()
+    {
+        offlineNextNodeOnPath(tree.view(), src.data(), dst.data(), out.data(), src.size());
+        doNotOptimize(out[0]);
+    }, options.minTime);
+    report(results, makeResult("Offline/query", "random", "uniform", n, runTimes, src.size()));
+}
+
+/*
+Times PathAggregate on a random tree with random weights: preprocessing and uniform queries,
+for the min and the sum of the weights on the path.
+*/
+// Exponents of the Zipf distributions of the cached queries, from uniform to heavily skewed
+static const double CACHE_ZIPF_EXPONENTS[] = {0, 0.8, 1.0, 1.2};
+
+static void benchCache(int n, const BenchOptions &options, std::mt19937 &rng, std::vector<BenchResult> &results)
+{
+    CSRTree tree(generateTree(SHAPE_RANDOM, n, rng));
+    const NextNodeOnPath nextNodeOnPath(tree.view());
+    const LCA lca(tree.view());
+    CachedNextNodeOnPath cachedNextNodeOnPath(nextNodeOnPath);
+    CachedLCA cachedLCA(lca);
+
+    for (double exponent : CACHE_ZIPF_EXPONENTS)
+    {
+        std::vector<int> src, dst;
+        generateZipfQueries(n, options.queries, exponent, rng, src, dst);
+        std::ostringstream distribution;
+        distribution << "zipf-" << std::fixed << std::setprecision(1) << exponent;
+
+        std::vector<double> runTimes = measure([&]()
+        {
+            long sum = 0;
+            for (size_t q = 0; q < src.size(); q++)
+            {
+                sum += nextNodeOnPath.query(src[q], dst[q]);
+            }
+            doNotOptimize(sum);
+        }, options.minTime);
+        report(results, makeResult("Uncached/query", "random", distribution.str(), n, runTimes, src.size()));
+
+        // each run starts from an empty cache
+        runTimes = measure([&]()
+        {
+            cachedNextNodeOnPath.queryCache().clear();
+            long sum = 0;
+            for (size_t q = 0; q < src.size(); q++)
+            {
+                sum += cachedNextNodeOnPath.query(src[q], dst[q]);
+            }
+            doNotOptimize(sum);
+        }, options.minTime);
+        report(results, makeResult("Cached/query", "random", distribution.str(), n, runTimes, src.size()));
+
+        runTimes = measure([&]()
+        {
+            long sum = 0;
+            for (size_t q = 0; q < src.size(); q++)
+            {
+                sum += lca.lca(src[q], dst[q]);
+            }
+            doNotOptimize(sum);
+        }, options.minTime);
+        report(results, makeResult("Uncached/lca", "random", distribution.str(), n, runTimes, src.size()));
+
+        runTimes = measure([&]()
+        {
+            cachedLCA.queryCache().clear();
+            long sum = 0;
+            for (size_t q = 0; q < src.size(); q++)
+            {
+                sum += cachedLCA.query(src[q], dst[q]);
+            }
+            doNotOptimize(sum);
+        }, options.minTime);
+        report(results, makeResult("Cached/lca", "random", distribution.str(), n, runTimes, src.size()));
+
+        // the hit rate, from a counting cache outside of the timed runs
+        CachedLCA countingLCA(lca, QUERY_CACHE_DEFAULT_ENTRIES, true);
+        for (size_t q = 0; q < src.size(); q++)
+        {
+            countingLCA.query(src[q], dst[q]);
+        }
+        const QueryCache &cache = countingLCA.queryCache();
+        std::cout << std::setw(59) << std::fixed << std::setprecision(2)
+                  << 100.0 * cache.hits() / (cache.hits() + cache.misses()) << "% hits, "
+                  << cache.capacity() << " entries" << std::endl;
+    }
+}
+
+static void benchPathAggregate(int n, TreeShape shape, const BenchOptions &options, std::mt19937 &rng, std::vector<BenchResult> &results)
+{
+    CSRTree tree(generateTree(shape, n, rng));
+    const char *shapeName = treeShapeName(shape);
+    std::vector<long long> weights(n);
+    for (long long &w : weights)
+    {
+        w = rng() % 1000;
+    }
+    std::vector<int> src(options.queries), dst(options.queries);
+    for (size_t q = 0; q < options.queries; q++)
+    {
+        src[q] = rng() % n;
+        dst[q] = rng() % n;
+    }
+
+    std::vector<double> runTimes = measure([&]() { PathAggregate<long long> pathSum(tree.view(), weights); }, options.minTime);
+    report(results, makeResult("PathAggregate/preprocess", shapeName, "", n, runTimes, 1));
+
+    const PathAggregate<long long, PathMin<long long>> pathMin(tree.view(), weights);
+    runTimes = measure([&]()
+    {
+        long sum = 0;
+        for (size_t q = 0; q < src.size(); q++)
+        {
+            sum += pathMin.query(src[q], dst[q]);
+        }
+        doNotOptimize(sum);
+    }, options.minTime);
+    report(results, makeResult("PathAggregate/min", shapeName, "uniform", n, runTimes, src.size()));
+
+    const PathAggregate<long long> pathSum(tree.view(), weights);
+    runTimes = measure([&]()
+    {
+        long sum = 0;
+        for (size_t q = 0; q < src.size(); q++)
+        {
+            sum += pathSum.query(src[q], dst[q]);
+        }
+        doNotOptimize(sum);
+    }, options.minTime);
+    report(results, makeResult("PathAggregate/sum", shapeName, "uniform", n, runTimes, src.size()));
+}
+
+/*
+Times the LCA block preprocessing kernels (BlockKernels.hpp) on a random +/-1 sequence of n elements,
+standing for the depths of an Euler Tour, with the block size LCA would pick, on one thread.
+The Sparse Table is timed over all its levels, keeping only the last two.
+*/
+static void benchKernels(int n, const BenchOptions &options, std::mt19937 &rng, std::vector<BenchResult> &results)
+{
+    std::vector<int> depth(n), index(n);
+    for (int i = 1; i < n; i++)
+    {
+        depth[i] = depth[i - 1] + (rng() % 2 ? 1 : -1);
+    }
+    int blockSize = 1 << std::min(LCA_MAX_BLOCK_BITS, std::max(0, (int)std::floor(std::log2(std::max(1.0, std::log2(n) / 2)))));
+    int blocks = n / blockSize;
+    const InBlockTables &tables = inBlockTables(blockSize);
+
+    std::vector<uint64_t> steps((n + 63) / 64);
+    std::vector<uint16_t> binaryStrings(blocks);
+    std::vector<int> prefixMin(n), suffixMin(n), blockMin(blocks), blockDepth(blocks);
+    std::vector<int> levelIndex[2] = {std::vector<int>(blocks), std::vector<int>(blocks)};
+    std::vector<int> levelDepth[2] = {std::vector<int>(blocks), std::vector<int>(blocks)};
+
+    for (int level = SIMD_SCALAR; level <= detectSimdLevel(); level++)
+    {
+        SimdLevel simd = (SimdLevel)level;
+        std::vector<double> runTimes = measure([&]() { upStepBits(depth.data(), n, 0, steps.size(), steps.data(), simd); }, options.minTime);
+        reportKernel(results, makeResult("Kernel/upStepBits", simdLevelName(simd), "", n, runTimes, n));
+
+        for (int b = 0; b < blocks; b++)
+        {
+            size_t pos = (size_t)b * blockSize;
+            uint64_t bits = steps[pos / 64] >> (pos % 64);
+            if (pos % 64 + blockSize - 1 > 64)
+                bits |= steps[pos / 64 + 1] << (64 - pos % 64);
+            binaryStrings[b] = bits & ((1u << (blockSize - 1)) - 1);
+        }
+        runTimes = measure([&]()
+        {
+            expandBlockMinima(binaryStrings.data(), 0, blocks, blockSize, tables, prefixMin.data(), suffixMin.data(), blockMin.data(), simd);
+        }, options.minTime);
+        reportKernel(results, makeResult("Kernel/expandBlockMinima", simdLevelName(simd), "", n, runTimes, n));
+
+        for (int b = 0; b < blocks; b++)
+        {
+            blockDepth[b] = depth[blockMin[b]];
+        }
+        runTimes = measure([&]()
+        {
+            const int *index = blockMin.data(), *depths = blockDepth.data();
+            for (size_t half = 1; 2 * half <= blocks; half *= 2)
+            {
+                std::vector<int> &outIndex = levelIndex[index == levelIndex[0].data()], &outDepth = levelDepth[index == levelIndex[0].data()];
+                sparseTableLevel(index, depths, 0, blocks - 2 * half + 1, half, outIndex.data(), outDepth.data(), simd);
+                index = outIndex.data();
+                depths = outDepth.data();
+            }
+        }, options.minTime);
+        reportKernel(results, makeResult("Kernel/sparseTable", simdLevelName(simd), "", n, runTimes, n));
+    }
+}
+
+static std::vector<TreeShape> parseShapes(const std::string &list)
+{
+    const TreeShape allShapes[] = {SHAPE_RANDOM, SHAPE_PATH, SHAPE_STAR, SHAPE_KARY, SHAPE_CATERPILLAR};
+    std::vector<TreeShape> shapes;
+    size_t start = 0;
+    while (start <= list.size())
+    {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos)
+            end = list.size();
+        std::string name = list.substr(start, end - start);
+        bool found = false;
+        for (TreeShape shape : allShapes)
+        {
+            if (name == treeShapeName(shape))
+            {
+                shapes.push_back(shape);
+                found = true;
+            }
+        }
+        if (!found)
+        {
+            throw std::invalid_argument("Unknown tree shape: " + name);
+        }
+        start = end + 1;
+    }
+    return shapes;
+}
+
+int main(int argc, char **argv)
+{
+    BenchOptions options;
+    for (int a = 1; a + 1 < argc; a += 2)
+    {
+        if (!std::strcmp(argv[a], "--min-exp"))
+            options.minExp = std::atoi(argv[a + 1]);
+        else if (!std::strcmp(argv[a], "--max-exp"))
+            options.maxExp = std::atoi(argv[a + 1]);
+        else if (!std::strcmp(argv[a], "--queries"))
+            options.queries = std::atol(argv[a + 1]);
+        else if (!std::strcmp(argv[a], "--min-time"))
+            options.minTime = std::atof(argv[a + 1]);
+        else if (!std::strcmp(argv[a], "--shapes"))
+            options.shapes = parseShapes(argv[a + 1]);
+        else if (!std::strcmp(argv[a], "--dynamic-max-exp"))
+            options.dynamicMaxExp = std::atoi(argv[a + 1]);
+        else if (!std::strcmp(argv[a], "--kernel-exp"))
+            options.kernelExp = std::atoi(argv[a + 1]);
+        else if (!std::strcmp(argv[a], "--csv"))
+            options.csvPath = argv[a + 1];
+        else if (!std::strcmp(argv[a], "--json"))
+            options.jsonPath = argv[a + 1];
+        else
+        {
+            std::cerr << "Unknown option " << argv[a] << "\n";
+            return 1;
+        }
+    }
+
+    std::mt19937 rng(12345);
+    std::vector<BenchResult> results;
+    int n = 1;
+    for (int e = 0; e < options.minExp; e++)
+        n *= 10;
+    for (int e = options.minExp; e <= options.maxExp; e++, n *= 10)
+    {
+        benchRMQ(n, options, rng, results);
+        for (TreeShape shape : options.shapes)
+        {
+            benchTree(n, shape, options, rng, results);
+            benchPathAggregate(n, shape, options, rng, results);
+        }
+        benchIncremental(n, options, rng, results);
+        benchForest(n, options, rng, results);
+        benchRelabel(n, options, rng, results);
+        benchMemory(n, options, rng, results);
+        benchSuccinct(n, options, rng, results);
+        benchOffline(n, options, rng, results);
+        benchCache(n, options, rng, results);
+        if (e <= options.dynamicMaxExp)
+        {
+            benchDynamic(n, options, rng, results);
+        }
+    }
+
+    if (options.kernelExp > 0)
+    {
+        n = 1;
+        for (int e = 0; e < options.kernelExp; e++)
+            n *= 10;
+        benchKernels(n, options, rng, results);
+    }
+
+    writeResultsCSV(results, options.csvPath);
+    writeResultsJSON(results, options.jsonPath);
+    std::cout << "Results written to " << options.csvPath << " and " << options.jsonPath << "\n";
+}
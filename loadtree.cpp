@@ -0,0 +1,120 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <sys/resource.h>
+#include "TreeLoader.hpp"
+#include "NextNodeOnPath.hpp"
+#include "EulerNextNodeOnPath.hpp"
+
+/*
+Loads a tree file and preprocesses it for next-node-on-path queries, reporting the time and the
+peak resident memory of each step. Usage:
+    ./loadtree <file> [--format parent-binary|parent-text|edges-binary|edges-text] [--root 0]
+                      [--engine nnop|euler] [--threads 0] [--save snapshot.bin]
+The root only applies to edge lists. --save writes a snapshot of the NextNodeOnPath engine.
+*/
+
+// peak resident memory of the process so far, in MB
+static double peakResidentMegabytes()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0; // ru_maxrss is in KB on Linux
+}
+
+static double elapsedMilliseconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void report(const std::string &step, double milliseconds)
+{
+    std::cout << std::left << std::setw(28) << step << std::right << std::fixed << std::setprecision(1)
+              << std::setw(12) << milliseconds << " ms" << std::setw(12) << peakResidentMegabytes()
+              << " MB peak RSS" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <file> [--format parent-binary|parent-text|edges-binary|edges-text]"
+                  << " [--root 0] [--engine nnop|euler] [--threads 0] [--save snapshot.bin]\n";
+        return 1;
+    }
+    std::string path = argv[1], engine = "nnop", snapshotPath;
+    TreeFileFormat format = TREE_FILE_PARENT_BINARY;
+    int root = 0, threads = 0;
+    for (int a = 2; a + 1 < argc; a += 2)
+    {
+        if (!std::strcmp(argv[a], "--format"))
+        {
+            const TreeFileFormat formats[] = {TREE_FILE_PARENT_BINARY, TREE_FILE_PARENT_TEXT, TREE_FILE_EDGES_BINARY, TREE_FILE_EDGES_TEXT};
+            bool known = false;
+            for (TreeFileFormat f : formats)
+            {
+                if (!std::strcmp(argv[a + 1], treeFileFormatName(f)))
+                {
+                    format = f;
+                    known = true;
+                }
+            }
+            if (!known)
+            {
+                std::cerr << "Unknown format " << argv[a + 1] << "\n";
+                return 1;
+            }
+        }
+        else if (!std::strcmp(argv[a], "--root"))
+            root = std::atoi(argv[a + 1]);
+        else if (!std::strcmp(argv[a], "--engine"))
+            engine = argv[a + 1];
+        else if (!std::strcmp(argv[a], "--threads"))
+            threads = std::atoi(argv[a + 1]);
+        else if (!std::strcmp(argv[a], "--save"))
+            snapshotPath = argv[a + 1];
+        else
+        {
+            std::cerr << "Unknown option " << argv[a] << "\n";
+            return 1;
+        }
+    }
+    if (engine != "nnop" && engine != "euler")
+    {
+        std::cerr << "Unknown engine " << engine << "\n";
+        return 1;
+    }
+
+    try
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        CSRTree tree = loadTree(path, format, root);
+        report("Loaded " + std::to_string(tree.view().size) + " nodes", elapsedMilliseconds(start));
+
+        start = std::chrono::steady_clock::now();
+        if (engine == "euler")
+        {
+            EulerNextNodeOnPath eulerNextNodeOnPath(tree.view(), threads);
+            report("Built EulerNextNodeOnPath", elapsedMilliseconds(start));
+        }
+        else
+        {
+            NextNodeOnPath nextNodeOnPath(tree.view(), threads);
+            report("Built NextNodeOnPath", elapsedMilliseconds(start));
+            if (!snapshotPath.empty())
+            {
+                start = std::chrono::steady_clock::now();
+                nextNodeOnPath.save(snapshotPath);
+                report("Saved " + snapshotPath, elapsedMilliseconds(start));
+            }
+        }
+    }
+    catch (const std::exception &error)
+    {
+        std::cerr << error.what() << "\n";
+        return 1;
+    }
+}
@@ -13,7 +13,7 @@ int main()
     std::vector<int> seq = {7, 4, 13, 10, -1, 21, 11, 14, 6, 7};
 
     // Preprocess sequence for RMQ queries
-    RMQ rmq(seq);
+    RMQ<int> rmq(seq);
 
     // Execute query
     int i = 2, j = 5;
@@ -46,4 +46,17 @@ int main()
     /*** Execute stress tests ***/
     testRMQ();
     testNextNodeOnPath();
+    testConcurrentQueries();
+    testDynamicTree();
+    testIncrementalNextNodeOnPath();
+    testForest();
+    testNodeRelabeling();
+    testArrayMemory();
+    testSuccinctTree();
+    testPathAggregate();
+    testEulerNextNodeOnPath();
+    testOfflineQueries();
+    testQueryCache();
+    testTreeLoader();
+    testBlockKernels();
 }
\ No newline at end of file